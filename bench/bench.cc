@@ -0,0 +1,221 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "net.hh"
+#include "kernels.hh"
+
+#include <cstdio>
+#include <sstream>
+
+//
+// Native benchmark of the network core, without V8: `run`, `run_batch`,
+// `learn`, `learn_step` and `mt_train` over a matrix of layers shapes, training
+// set sizes, thread counts and precisions. The results are written to stdout
+// as one JSON document, to be compared between builds.
+//
+// Usage: `bench [--quick]`
+//
+
+/******************************************************************************/
+/*                                 HELPERS                                    */
+/******************************************************************************/
+
+//
+// ### seconds
+// ```
+// @since {uint64_t} a uv_hrtime() value
+//
+// @return {double} the seconds elapsed since `since`
+// ```
+//
+static double seconds(uint64_t since)
+{
+  return (uv_hrtime() - since) / 1e9;
+}
+
+//
+// ### report
+// Writes one result line of the JSON document
+// ```
+// @bench     {const char*} the benchmark name
+// @precision {const char*} `float32` or `float64`
+// @layers    {vector<int>} the layers structure
+// @samples   {int} the training set size
+// @threads   {int} the number of threads
+// @ops       {double} the number of operations timed (inputs, points...)
+// @time      {double} the time taken in seconds
+// ```
+//
+static void report(const char* bench, const char* precision,
+                   const vector<int>& layers, int samples, int threads,
+                   double ops, double time)
+{
+  static bool first = true;
+  ostringstream oss;
+
+  oss << "[";
+  for(size_t l = 0; l < layers.size(); l++) {
+    oss << (l > 0 ? "," : "") << layers[l];
+  }
+  oss << "]";
+
+  printf("%s    {\"bench\":\"%s\",\"precision\":\"%s\",\"layers\":%s,"
+         "\"samples\":%d,\"threads\":%d,\"ops\":%.0f,\"seconds\":%.6f,"
+         "\"ops_per_sec\":%.1f}",
+         first ? "" : ",\n", bench, precision, oss.str().c_str(), samples,
+         threads, ops, time, time > 0 ? ops / time : 0.0);
+  first = false;
+  fflush(stdout);
+}
+
+/******************************************************************************/
+/*                               BENCHMARKS                                   */
+/******************************************************************************/
+
+//
+// ### bench
+// Runs every benchmark for one layers shape and training set size
+// ```
+// @layers  {vector<int>} the layers structure
+// @samples {int} the training set size
+// @threads {vector<int>} the thread counts of `mt_train`
+// @budget  {double} approximate time in seconds given to each measure
+// ```
+//
+template <typename T>
+static void bench(vector<int>& layers, int samples,
+                  const vector<int>& threads, double budget)
+{
+  const int in_dim = layers[0];
+  const int out_dim = layers[layers.size() - 1];
+
+  srand(1);
+  Net<T> nn(layers, (T)0.3, (T)0.1, (T)-1.0);
+  const char* precision = nn.precision();
+
+  /* Synthetic training set */
+  vector<T> in((size_t)samples * in_dim);
+  vector<T> out((size_t)samples * out_dim);
+  for(size_t i = 0; i < in.size(); i++) {
+    in[i] = (T)NN::fRand(-1.0, 1.0);
+  }
+  for(size_t i = 0; i < out.size(); i++) {
+    out[i] = (T)NN::fRand(0.0, 1.0);
+  }
+  nn.train_set_add(&in[0], &out[0], samples);
+
+  /* run: one input by call through the vector interface */
+  {
+    vector<double> x(in.begin(), in.begin() + in_dim);
+    int n = 0;
+    uint64_t start = uv_hrtime();
+    do {
+      for(int k = 0; k < 64; k++, n++) {
+        nn.run(x);
+      }
+    } while(seconds(start) < budget);
+    report("run", precision, layers, samples, 1, n, seconds(start));
+  }
+
+  /* run_batch: the whole training set at once */
+  {
+    vector<T> y((size_t)samples * out_dim);
+    int n = 0;
+    uint64_t start = uv_hrtime();
+    do {
+      nn.run_batch(&in[0], &y[0], samples);
+      n += samples;
+    } while(seconds(start) < budget);
+    report("run_batch", precision, layers, samples, 1, n, seconds(start));
+  }
+
+  /* learn: one point by call */
+  {
+    int n = 0;
+    uint64_t start = uv_hrtime();
+    do {
+      for(int k = 0; k < 64; k++, n++) {
+        size_t i = (size_t)(n % samples);
+        vector<T> x(in.begin() + i * in_dim, in.begin() + (i + 1) * in_dim);
+        vector<T> y(out.begin() + i * out_dim,
+                    out.begin() + (i + 1) * out_dim);
+        nn.learn(x, y);
+      }
+    } while(seconds(start) < budget);
+    report("learn", precision, layers, samples, 1, n, seconds(start));
+  }
+
+  /* learn_step: passes over the whole training set */
+  {
+    int n = 0;
+    uint64_t start = uv_hrtime();
+    do {
+      nn.learn_step();
+      n += samples;
+    } while(seconds(start) < budget);
+    report("learn_step", precision, layers, samples, 1, n, seconds(start));
+  }
+
+  /* mt_train: iterations over the whole training set */
+  for(size_t t = 0; t < threads.size(); t++) {
+    int n = 0;
+    uint64_t start = uv_hrtime();
+    do {
+      nn.mt_train(1e-12, 1, 100, threads[t], 1, false);
+      n += samples;
+    } while(seconds(start) < budget);
+    report("mt_train", precision, layers, samples, threads[t], n,
+           seconds(start));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  bool quick = argc > 1 && std::string(argv[1]) == "--quick";
+  double budget = quick ? 0.05 : 0.5;
+
+  int shapes[][5] = {
+    { 1, 4, 3, 1, 0 },
+    { 16, 64, 1, 0, 0 },
+    { 64, 256, 64, 10, 0 },
+    { 256, 1024, 256, 10, 0 }
+  };
+  int sizes[] = { 1000, 10000 };
+  int counts[] = { 1, 2, 4, 8 };
+  vector<int> threads(counts, counts + (quick ? 2 : 4));
+
+  printf("{\n  \"isa\":\"%s\",\n  \"results\":[\n",
+         SIMD_NN::isa_name(SIMD_NN::isa));
+
+  for(size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+    vector<int> layers;
+    for(int l = 0; l < 5 && shapes[s][l] > 0; l++) {
+      layers.push_back(shapes[s][l]);
+    }
+    for(size_t n = 0; n < (quick ? 1 : sizeof(sizes) / sizeof(sizes[0])); n++) {
+      bench<double>(layers, sizes[n], threads, budget);
+      bench<float>(layers, sizes[n], threads, budget);
+    }
+  }
+
+  printf("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,259 @@
+#!/usr/bin/env node
+/*
+ * NeuralN: bench/train.js
+ *
+ * (c) Copyright Teleportd Ltd. 2014, All rights reserved.
+ *
+ * @log:
+ * 2026-10-16   Creation
+ */
+"use strict"
+
+var fs = require('fs');
+var NeuralN = require('../index.js');
+
+//
+// The `train` benchmark measures the convergence of every training mode
+// against the wall clock time on deterministic synthetic datasets. Each mode
+// starts from the same weights and trains by rounds of `iterations`; after
+// each round the error on the whole training set is measured (not timed).
+//
+// Usage: `bench/train.js [--dataset regression|classification|sparse]
+//                        [--threads 1,2,4] [--rounds 10] [--iterations 5]
+//                        [--points 10000] [--target 0.01] [--out file.json]`
+//
+// The results (error and samples/sec by round, time to the target error) are
+// written as JSON to `--out` (default `bench_train.json`).
+//
+
+/******************************************************************************/
+/*                                 OPTIONS                                    */
+/******************************************************************************/
+
+var options = {
+  dataset: null,
+  threads: '1,2,4',
+  rounds: 10,
+  iterations: 5,
+  points: 10000,
+  target: 0.01,
+  step_size: 100,
+  out: 'bench_train.json'
+};
+
+for(var a = 2; a < process.argv.length - 1; a += 2) {
+  var key = process.argv[a].replace(/^--/, '');
+  if(!options.hasOwnProperty(key)) {
+    console.log('Unknown option `' + process.argv[a] + '`');
+    process.exit(1);
+  }
+  options[key] = typeof options[key] === 'number' ?
+    parseFloat(process.argv[a + 1]) : process.argv[a + 1];
+}
+var THREADS = options.threads.split(',').map(function(t) {
+  return parseInt(t, 10);
+});
+
+/******************************************************************************/
+/*                                DATASETS                                    */
+/******************************************************************************/
+
+/* Seeded pseudo random generator (LCG) so that datasets are reproducible */
+var generator = function(seed) {
+  var state = seed;
+  return function() {
+    state = (state * 69069 + 1) % 4294967296;
+    return state / 4294967296;
+  };
+};
+
+//
+// Each generator returns `{ layers, inputs, outputs }`, the points being packed
+// in Float64Arrays as expected by `train_set_add_bulk`
+//
+var datasets = {
+  /* smooth function of 8 inputs */
+  regression: function(points) {
+    var random = generator(1);
+    var dim = 8;
+    var inputs = new Float64Array(points * dim);
+    var outputs = new Float64Array(points);
+    for(var i = 0; i < points; i++) {
+      var s = 0;
+      for(var j = 0; j < dim; j++) {
+        var x = random() * 2 - 1;
+        inputs[i * dim + j] = x;
+        s += Math.sin((j + 1) * x);
+      }
+      outputs[i] = 0.5 + 0.5 * Math.tanh(s / dim);
+    }
+    return { layers: [ dim, 32, 1 ], inputs: inputs, outputs: outputs };
+  },
+
+  /* 4 gaussian blobs in 16 dimensions, one output by class */
+  classification: function(points) {
+    var random = generator(2);
+    var dim = 16;
+    var classes = 4;
+    var centers = [];
+    for(var c = 0; c < classes * dim; c++) {
+      centers.push(random() * 2 - 1);
+    }
+    var inputs = new Float64Array(points * dim);
+    var outputs = new Float64Array(points * classes);
+    for(var i = 0; i < points; i++) {
+      var k = Math.floor(random() * classes);
+      for(var j = 0; j < dim; j++) {
+        /* approximately normal noise: sum of uniforms */
+        var noise = (random() + random() + random() - 1.5) * 0.5;
+        inputs[i * dim + j] = centers[k * dim + j] + noise;
+      }
+      outputs[i * classes + k] = 1;
+    }
+    return { layers: [ dim, 16, classes ], inputs: inputs,
+             outputs: outputs };
+  },
+
+  /* 256 inputs, 5% of them non zero, the output depending on a few ones */
+  sparse: function(points) {
+    var random = generator(3);
+    var dim = 256;
+    var inputs = new Float64Array(points * dim);
+    var outputs = new Float64Array(points);
+    for(var i = 0; i < points; i++) {
+      for(var j = 0; j < dim; j++) {
+        if(random() < 0.05) {
+          inputs[i * dim + j] = random();
+        }
+      }
+      var s = inputs[i * dim] + inputs[i * dim + 1] - inputs[i * dim + 2] +
+        0.5 * inputs[i * dim + 3];
+      outputs[i] = 1 / (1 + Math.exp(-4 * s));
+    }
+    return { layers: [ dim, 32, 1 ], inputs: inputs, outputs: outputs };
+  }
+};
+
+/******************************************************************************/
+/*                                BENCHMARK                                   */
+/******************************************************************************/
+
+/* Mean square error on the whole training set */
+var error = function(network, data, points) {
+  var out_dim = data.layers[data.layers.length - 1];
+  var result = network.run_batch(data.inputs, points);
+  var err = 0;
+  for(var i = 0; i < result.length; i++) {
+    err += (result[i] - data.outputs[i]) * (result[i] - data.outputs[i]);
+  }
+  return err / (points * out_dim);
+};
+
+//
+// ### run_mode
+// Trains a network from `state` by rounds with the given mode
+// ```
+// @data    {object} the dataset
+// @state   {string} the initial network
+// @mode    {object} `{ name, multithread, mode, threads }`
+// @cb_     {function(result)}
+// ```
+//
+var run_mode = function(data, state, mode, cb_) {
+  var network = new NeuralN(state);
+  network.train_set_add_bulk(data.inputs, data.outputs, options.points);
+
+  var result = {
+    mode: mode.name,
+    threads: mode.threads,
+    rounds: [],
+    time_to_target: null
+  };
+  var elapsed = 0;
+  var round = 0;
+
+  var next = function() {
+    if(round === options.rounds)
+      return cb_(result);
+
+    var start = Date.now();
+    var done = function(err) {
+      if(err)
+        throw err;
+      elapsed += Date.now() - start;
+      round++;
+
+      var e = error(network, data, options.points);
+      var samples = round * options.iterations * options.points;
+      result.rounds.push({
+        iterations: round * options.iterations,
+        elapsed: elapsed,
+        error: e,
+        samples_per_sec: elapsed > 0 ? samples / elapsed * 1000 : 0
+      });
+      if(result.time_to_target === null && e <= options.target)
+        result.time_to_target = elapsed;
+
+      console.log(mode.name + '\t' + mode.threads + '\t' +
+                  round * options.iterations + '\t' + elapsed + '\t' +
+                  e.toFixed(8));
+      next();
+    };
+
+    network.train({
+      target_error: 1e-12,
+      iterations: options.iterations,
+      multithread: mode.multithread,
+      mode: mode.mode,
+      step_size: options.step_size,
+      threads: mode.threads
+    }, done);
+  };
+  next();
+};
+
+var modes = [ { name: 'train', multithread: false, threads: 1 } ];
+THREADS.forEach(function(t) {
+  modes.push({ name: 'mt_train', multithread: true, mode: 'averaging',
+               threads: t });
+  modes.push({ name: 'hogwild', multithread: true, mode: 'hogwild',
+               threads: t });
+});
+
+var names = options.dataset ? [ options.dataset ] : Object.keys(datasets);
+var results = {
+  options: options,
+  datasets: {}
+};
+
+var bench_dataset = function(d) {
+  if(d === names.length) {
+    fs.writeFileSync(options.out, JSON.stringify(results, null, 2));
+    console.log('Results written to ' + options.out);
+    return;
+  }
+  var name = names[d];
+  if(!datasets[name]) {
+    console.log('Unknown dataset `' + name + '`');
+    process.exit(1);
+  }
+
+  var data = datasets[name](options.points);
+  var state = new NeuralN(data.layers).to_string();
+  results.datasets[name] = { layers: data.layers, modes: [] };
+
+  console.log('DATASET: ' + name + ' LAYERS: ' + JSON.stringify(data.layers));
+  console.log('mode\tthreads\titerations\tms\terror');
+
+  var m = 0;
+  var bench_mode = function() {
+    if(m === modes.length)
+      return bench_dataset(d + 1);
+    run_mode(data, state, modes[m++], function(result) {
+      results.datasets[name].modes.push(result);
+      bench_mode();
+    });
+  };
+  bench_mode();
+};
+bench_dataset(0);
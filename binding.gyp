@@ -1,8 +1,44 @@
 {
+  "variables": {
+    "nn_bench%": 0,
+    "nn_stats%": 1,
+    "nn_test%": 0
+  },
   "targets": [
     {
       "target_name": "nn",
-      "sources": [ "lib/nn.cc" ]
+      "sources": [ "lib/nn.cc", "lib/net.cc", "lib/kernels.cc",
+                   "lib/cache.cc" ],
+      "conditions": [
+        [ "nn_stats==1", {
+          "defines": [ "NN_STATS" ]
+        } ]
+      ]
     }
+  ],
+  "conditions": [
+    [ "nn_bench==1", {
+      "targets": [
+        {
+          "target_name": "bench",
+          "type": "executable",
+          "sources": [ "bench/bench.cc", "lib/nn.cc", "lib/net.cc",
+                       "lib/kernels.cc", "lib/cache.cc" ],
+          "include_dirs": [ "lib" ],
+          "defines": [ "NN_STANDALONE", "NN_STATS" ],
+          "libraries": [ "-luv", "-lpthread" ]
+        }
+      ]
+    } ],
+    [ "nn_test==1", {
+      "targets": [
+        {
+          "target_name": "kernels_test",
+          "type": "executable",
+          "sources": [ "test/kernels.cc", "lib/kernels.cc" ],
+          "include_dirs": [ "lib" ]
+        }
+      ]
+    } ]
   ]
 }
@@ -20,9 +20,7 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE.
 var nn = require('./build/Release/nn.node');
 
-module.exports = function(layers, momentum, learning_rate, bias) {
-  var network = new nn.NN(layers, momentum, learning_rate, bias);
-
+var wrap = function(network) {
   var test_value = function(fn, value) {
     if(fn(value))
       throw new Error('Bad string format');
@@ -35,6 +33,12 @@ module.exports = function(layers, momentum, learning_rate, bias) {
     train_set_add:function(input, output) {
       return network.train_set_add(input, output);
     },
+    train_set_add_bulk: function(inputs, outputs, count) {
+      return network.train_set_add_bulk(inputs, outputs, count);
+    },
+    train_set_mmap: function(path) {
+      return network.train_set_mmap(path);
+    },
     train: function(options, callback) {
       if(typeof options === 'function') {
         callback = options;
@@ -45,6 +49,7 @@ module.exports = function(layers, momentum, learning_rate, bias) {
       var iterations = 20000;
       var step_size = 100;
       var threads = 4;
+      var batch_size = 1;
 
       if(typeof options.target_error === 'number')
         target_error = options.target_error;
@@ -54,22 +59,81 @@ module.exports = function(layers, momentum, learning_rate, bias) {
         step_size = options.step_size;
       if(typeof options.threads === 'number')
         threads = options.threads;
+      if(typeof options.batch_size === 'number')
+        batch_size = options.batch_size;
+
+      /* auto: `threads` is the maximum, up to the number of cores */
+      var tune = !!options.auto;
+      if(tune && typeof options.threads !== 'number')
+        threads = require('os').cpus().length;
+
+      /* asynchronous trainings return a handle to cancel them */
+      var handle = {
+        cancel: function() {
+          network.cancel();
+        }
+      };
+      var on_progress = typeof options.on_progress === 'function' ?
+        options.on_progress : undefined;
 
-      if(options.multithread) {
-        return network.mt_train(target_error, iterations, step_size, threads, callback);
+      if(options.multithread && options.mode === 'hogwild') {
+        network.hogwild_train(target_error, iterations, threads,
+                              callback || function() {}, on_progress);
+        return handle;
+      }
+      else if(options.multithread) {
+        network.mt_train(target_error, iterations, step_size, threads,
+                         batch_size, callback || function() {}, on_progress,
+                         tune);
+        return handle;
       }
       else {
-        network.train(target_error, iterations);
+        network.train(target_error, iterations, batch_size);
         if(typeof callback === 'function')
           return callback();
       }
     },
+    cancel: function() {
+      return network.cancel();
+    },
+    set_stats: function(enabled) {
+      return network.set_stats(enabled);
+    },
+    get_stats: function() {
+      return network.get_stats();
+    },
+    set_cache: function(capacity) {
+      return network.set_cache(capacity);
+    },
+    get_cache: function() {
+      return network.get_cache();
+    },
     run: function(input) {
       return network.run(input);
     },
+    run_async: function(input, callback) {
+      return network.run_async(input, callback);
+    },
+    run_batch: function(input, n, output) {
+      if(typeof n !== 'number')
+        return network.run_batch(input, undefined, n);
+      return network.run_batch(input, n, output);
+    },
+    precision: function() {
+      return network.precision();
+    },
     to_string: function() {
       return network.to_string();
     },
+    save: function(path) {
+      return network.save(path);
+    },
+    prune: function(options) {
+      options = options || {};
+      var threshold = typeof options.threshold === 'number' ?
+        options.threshold : 0;
+      return network.prune(threshold, options.sparsity);
+    },
     get_state: function(compact) {
       return network.get_state(compact);
     },
@@ -152,3 +216,43 @@ module.exports = function(layers, momentum, learning_rate, bias) {
     }
   }
 };
+
+module.exports = function(layers, momentum, learning_rate, bias) {
+  /* `new NeuralN(layers, { precision: 'float32', activation: 'relu' })` */
+  var precision = 'float64';
+  var activations = undefined;
+  if(typeof momentum === 'object' && momentum !== null) {
+    var options = momentum;
+    if(typeof options.precision === 'string')
+      precision = options.precision;
+
+    /* `activation` is either one activation for all the hidden layers or */
+    /* the activations of all the layers but the input one                */
+    if(Array.isArray(layers) &&
+       (options.activation || options.output_activation || options.fast)) {
+      activations = [];
+      for(var l = 1; l < layers.length; l++) {
+        var act = 'sigmoid';
+        if(Array.isArray(options.activation))
+          act = options.activation[l - 1] || act;
+        else if(typeof options.activation === 'string' &&
+                l < layers.length - 1)
+          act = options.activation;
+        if(typeof options.output_activation === 'string' &&
+           l === layers.length - 1)
+          act = options.output_activation;
+        if(options.fast && (act === 'sigmoid' || act === 'tanh'))
+          act = 'fast_' + act;
+        activations.push(act);
+      }
+    }
+  }
+
+  return wrap(new nn.NN(layers, precision, activations));
+};
+
+/* `NeuralN.load(path, { mmap: true })` */
+module.exports.load = function(path, options) {
+  options = options || {};
+  return wrap(nn.load(path, !!options.mmap));
+};
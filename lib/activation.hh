@@ -0,0 +1,260 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef NN_ACTIVATION_HH
+#define NN_ACTIVATION_HH
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+
+/******************************************************************************/
+/*                              ACTIVATIONS                                   */
+/******************************************************************************/
+
+//
+// The activation of a layer is applied to the whole vector of its incoming
+// sums at once, and its derivative is computed from the activated values only
+// (the mini-batch passes do not keep the sums). The loops are branch free so
+// that the compiler can vectorize them. The `FAST_` variants replace `exp` by
+// a polynomial approximation (relative error below 3e-6).
+//
+namespace ACT_NN {
+  //
+  // ### Activation
+  // The values are stored in the binary network files: never renumber them
+  //
+  enum Activation {
+    SIGMOID = 0,
+    TANH,
+    RELU,
+    LEAKY_RELU,
+    LINEAR,
+    FAST_SIGMOID,
+    FAST_TANH,
+    ACTIVATION_COUNT
+  };
+
+  /* slope of the leaky ReLU for negative sums */
+  const double LEAKY_SLOPE = 0.01;
+
+  //
+  // ### name
+  // ```
+  // @act {int} the activation
+  //
+  // @return {const char*} the name used in the network strings
+  // ```
+  //
+  inline const char* name(int act) {
+    static const char* names[ACTIVATION_COUNT] = {
+      "sigmoid", "tanh", "relu", "leaky_relu", "linear",
+      "fast_sigmoid", "fast_tanh"
+    };
+    return (act >= 0 && act < ACTIVATION_COUNT) ? names[act] : "unknown";
+  }
+
+  //
+  // ### parse
+  // ```
+  // @str {std::string} an activation name
+  //
+  // @return {int} the activation, -1 if `str` is not a known name
+  // ```
+  //
+  inline int parse(const std::string& str) {
+    for(int a = 0; a < ACTIVATION_COUNT; a++) {
+      if(str == name(a)) {
+        return a;
+      }
+    }
+    return -1;
+  }
+
+  //
+  // ### exp2i
+  // ```
+  // @k {int} an exponent in the normal range of T
+  //
+  // @return {T} 2^k, built from its bits
+  // ```
+  //
+  template <typename T> inline T exp2i(int k);
+
+  template <> inline float exp2i<float>(int k) {
+    int bits = (k + 127) << 23;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  template <> inline double exp2i<double>(int k) {
+    long long bits = (long long)(k + 1023) << 52;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  //
+  // ### clampi
+  // A floating point comparison followed by the arithmetic of `fast_exp` is
+  // turned into branches (the arithmetic may trap), which keeps the loops from
+  // being vectorized: the magnitude is clamped on the bits instead.
+  // ```
+  // @x   {T} a value
+  // @lim {T} a positive limit
+  //
+  // @return {T} `x` clamped to [-lim, lim]
+  // ```
+  //
+  template <typename T> inline T clampi(T x, T lim);
+
+  template <> inline float clampi<float>(float x, float lim) {
+    int bits, max;
+    memcpy(&bits, &x, sizeof(x));
+    memcpy(&max, &lim, sizeof(lim));
+    bits = (bits & ~0x7fffffff) | std::min(bits & 0x7fffffff, max);
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+  }
+  template <> inline double clampi<double>(double x, double lim) {
+    /* on the high word only, 64 bits comparisons needing SSE4.2: the low */
+    /* word moves the limit by 2^-20 relative at most                     */
+    unsigned long long bits, max;
+    memcpy(&bits, &x, sizeof(x));
+    memcpy(&max, &lim, sizeof(lim));
+    int hi = (int)(bits >> 32);
+    hi = (hi & ~0x7fffffff) | std::min(hi & 0x7fffffff, (int)(max >> 32));
+    bits = ((unsigned long long)(unsigned int)hi << 32) |
+           (bits & 0xffffffffULL);
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+  }
+
+  //
+  // ### fast_exp
+  // e^x = 2^k * 2^f with k the nearest integer of x / ln(2) and |f| <= 0.5,
+  // 2^f being approximated by its Taylor polynomial of degree 6. `x` is
+  // clamped to [-80, 80], whose image is in the normal range of floats.
+  // ```
+  // @x {T} the exponent
+  // ```
+  //
+  template <typename T>
+  inline T fast_exp(T x) {
+    x = clampi(x, (T)80);
+    T t = x * (T)1.4426950408889634;
+    int k = (int)(t + (T)128.5) - 128;
+    T f = (t - (T)k) * (T)0.6931471805599453;
+    T p = (T)1 + f * ((T)1 + f * ((T)(1.0 / 2) + f * ((T)(1.0 / 6) +
+          f * ((T)(1.0 / 24) + f * ((T)(1.0 / 120) + f * (T)(1.0 / 720))))));
+    return p * exp2i<T>(k);
+  }
+
+  //
+  // ### apply
+  // ```
+  // @act {int} the activation
+  // @sum {const T*} the incoming sums
+  // @val {T*} the activated values (may be `sum`)
+  // @n   {int} vectors length
+  // ```
+  //
+  template <typename T>
+  inline void apply(int act, const T* sum, T* val, int n) {
+    switch(act) {
+      case TANH:
+        for(int i = 0; i < n; i++) {
+          val[i] = std::tanh(sum[i]);
+        }
+        break;
+      case RELU:
+        for(int i = 0; i < n; i++) {
+          val[i] = sum[i] > (T)0 ? sum[i] : (T)0;
+        }
+        break;
+      case LEAKY_RELU:
+        for(int i = 0; i < n; i++) {
+          val[i] = sum[i] > (T)0 ? sum[i] : (T)LEAKY_SLOPE * sum[i];
+        }
+        break;
+      case LINEAR:
+        if(val != sum) {
+          memcpy(val, sum, n * sizeof(T));
+        }
+        break;
+      case FAST_SIGMOID:
+        for(int i = 0; i < n; i++) {
+          val[i] = (T)1 / ((T)1 + fast_exp(-sum[i]));
+        }
+        break;
+      case FAST_TANH:
+        for(int i = 0; i < n; i++) {
+          val[i] = (T)2 / ((T)1 + fast_exp((T)-2 * sum[i])) - (T)1;
+        }
+        break;
+      default:
+        for(int i = 0; i < n; i++) {
+          val[i] = (T)1 / ((T)1 + std::exp(-sum[i]));
+        }
+    }
+  }
+
+  //
+  // ### derive
+  // Multiplies the deltas by the derivative of the activation
+  // ```
+  // @act {int} the activation
+  // @val {const T*} the activated values
+  // @D   {T*} the deltas
+  // @n   {int} vectors length
+  // ```
+  //
+  template <typename T>
+  inline void derive(int act, const T* val, T* D, int n) {
+    switch(act) {
+      case TANH:
+      case FAST_TANH:
+        for(int i = 0; i < n; i++) {
+          D[i] *= (T)1 - val[i] * val[i];
+        }
+        break;
+      case RELU:
+        for(int i = 0; i < n; i++) {
+          D[i] = val[i] > (T)0 ? D[i] : (T)0;
+        }
+        break;
+      case LEAKY_RELU:
+        for(int i = 0; i < n; i++) {
+          D[i] *= val[i] > (T)0 ? (T)1 : (T)LEAKY_SLOPE;
+        }
+        break;
+      case LINEAR:
+        break;
+      default:
+        for(int i = 0; i < n; i++) {
+          D[i] *= val[i] * (1 - val[i]);
+        }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,288 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "cache.hh"
+
+#include <string.h>
+
+//
+// ### Cache
+//
+Cache::Cache()
+{
+  uv_mutex_init(&mutex_);
+  capacity_ = 0;
+  in_size_ = 0;
+  out_size_ = 0;
+  generation_ = 0;
+  synced_ = 0;
+  base_ = 0;
+  size_ = 0;
+  head_ = -1;
+  tail_ = -1;
+  hits_ = 0;
+  misses_ = 0;
+  evictions_ = 0;
+}
+
+//
+// ### ~Cache
+//
+Cache::~Cache()
+{
+  uv_mutex_destroy(&mutex_);
+}
+
+//
+// ### resize
+// ```
+// @capacity {int} max number of entries, 0 to disable the cache
+// @in_size  {int} the input vectors size
+// @out_size {int} the output vectors size
+// ```
+//
+void Cache::resize(int capacity, int in_size, int out_size)
+{
+  uv_mutex_lock(&mutex_);
+  capacity = capacity > 0 ? capacity : 0;
+
+  int buckets = 1;
+  while(buckets < capacity) {
+    buckets <<= 1;
+  }
+
+  in_size_ = in_size;
+  out_size_ = out_size;
+  entries_.assign(capacity, Entry());
+  data_.assign((size_t)capacity * (in_size + out_size), 0.0);
+  buckets_.assign(capacity > 0 ? buckets : 0, -1);
+  size_ = 0;
+  head_ = -1;
+  tail_ = -1;
+  synced_ = generation();
+  base_ = synced_;
+  hits_ = 0;
+  misses_ = 0;
+  evictions_ = 0;
+  capacity_ = capacity;
+  uv_mutex_unlock(&mutex_);
+}
+
+//
+// ### hash
+// ```
+// @in {const double*} the input vector
+// @n  {int} its size
+// ```
+//
+uint64_t Cache::hash(const double* in, int n)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for(int i = 0; i < n; i++) {
+    uint64_t w;
+    memcpy(&w, &in[i], sizeof(w));
+    h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+//
+// ### find
+// ```
+// @in {const double*} the input vector
+// @h  {uint64_t} its hash
+//
+// @return {int} the entry of `in`, -1 if not found
+// ```
+//
+int Cache::find(const double* in, uint64_t h) const
+{
+  int e = buckets_[h & (buckets_.size() - 1)];
+  while(e >= 0) {
+    const double* key = &data_[(size_t)e * (in_size_ + out_size_)];
+    if(entries_[e].hash == h &&
+       memcmp(key, in, in_size_ * sizeof(double)) == 0) {
+      return e;
+    }
+    e = entries_[e].chain;
+  }
+  return -1;
+}
+
+//
+// ### unlink / push_front
+// Removes an entry from / inserts it at the head of the LRU list
+//
+void Cache::unlink(int e)
+{
+  Entry& entry = entries_[e];
+  if(entry.prev >= 0) entries_[entry.prev].next = entry.next;
+  else head_ = entry.next;
+  if(entry.next >= 0) entries_[entry.next].prev = entry.prev;
+  else tail_ = entry.prev;
+}
+
+void Cache::push_front(int e)
+{
+  entries_[e].prev = -1;
+  entries_[e].next = head_;
+  if(head_ >= 0) entries_[head_].prev = e;
+  head_ = e;
+  if(tail_ < 0) tail_ = e;
+}
+
+//
+// ### unchain
+// Removes an entry from its bucket
+//
+void Cache::unchain(int e)
+{
+  int* p = &buckets_[entries_[e].hash & (buckets_.size() - 1)];
+  while(*p != e) {
+    p = &entries_[*p].chain;
+  }
+  *p = entries_[e].chain;
+}
+
+//
+// ### sync
+// Drops all the entries if the weights changed since they were computed
+//
+void Cache::sync()
+{
+  uint64_t g = generation();
+  if(g != synced_) {
+    if(size_ > 0) {
+      buckets_.assign(buckets_.size(), -1);
+      size_ = 0;
+      head_ = -1;
+      tail_ = -1;
+    }
+    synced_ = g;
+  }
+}
+
+//
+// ### lookup
+// ```
+// @in  {const double*} the input vector
+// @out {double*} filled with the cached output on hit
+//
+// @return {bool} whether the input was found
+// ```
+//
+bool Cache::lookup(const double* in, double* out)
+{
+  if(capacity_ == 0) {
+    return false;
+  }
+  uint64_t h = hash(in, in_size_);
+
+  uv_mutex_lock(&mutex_);
+  bool hit = false;
+  if(capacity_ > 0) {
+    this->sync();
+    int e = this->find(in, h);
+    if(e >= 0) {
+      const double* val = &data_[(size_t)e * (in_size_ + out_size_) + in_size_];
+      memcpy(out, val, out_size_ * sizeof(double));
+      if(e != head_) {
+        this->unlink(e);
+        this->push_front(e);
+      }
+      hits_++;
+      hit = true;
+    }
+    else {
+      misses_++;
+    }
+  }
+  uv_mutex_unlock(&mutex_);
+
+  return hit;
+}
+
+//
+// ### insert
+// ```
+// @in         {const double*} the input vector
+// @out        {const double*} its output vector
+// @generation {uint64_t} the `generation` read before running `in`
+// ```
+//
+void Cache::insert(const double* in, const double* out, uint64_t generation)
+{
+  if(capacity_ == 0) {
+    return;
+  }
+  uint64_t h = hash(in, in_size_);
+
+  uv_mutex_lock(&mutex_);
+  this->sync();
+  if(capacity_ > 0 && generation == synced_) {
+    int e = this->find(in, h);
+    if(e >= 0) {
+      this->unlink(e);
+    }
+    else {
+      if(size_ < capacity_) {
+        e = size_++;
+      }
+      else {
+        e = tail_;
+        this->unlink(e);
+        this->unchain(e);
+        evictions_++;
+      }
+      int b = (int)(h & (buckets_.size() - 1));
+      entries_[e].hash = h;
+      entries_[e].chain = buckets_[b];
+      buckets_[b] = e;
+    }
+    this->push_front(e);
+
+    double* key = &data_[(size_t)e * (in_size_ + out_size_)];
+    memcpy(key, in, in_size_ * sizeof(double));
+    memcpy(key + in_size_, out, out_size_ * sizeof(double));
+  }
+  uv_mutex_unlock(&mutex_);
+}
+
+//
+// ### get_counters
+// ```
+// @counters {Counters} filled with a snapshot of the counters
+// ```
+//
+void Cache::get_counters(Counters* counters)
+{
+  uv_mutex_lock(&mutex_);
+  this->sync();
+  counters->hits = hits_;
+  counters->misses = misses_;
+  counters->evictions = evictions_;
+  counters->invalidations = synced_ - base_;
+  counters->size = size_;
+  counters->capacity = capacity_;
+  uv_mutex_unlock(&mutex_);
+}
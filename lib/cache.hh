@@ -0,0 +1,173 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef NN_CACHE_HH
+#define NN_CACHE_HH
+
+#include <vector>
+#include <stdint.h>
+#include <uv.h>
+
+using namespace std;
+
+//
+// ## Cache Class
+// Bounded LRU cache of the outputs of `run`, keyed by the input vector. The
+// entries are tagged with the generation of the weights they were computed
+// with: every update of the weights calls `invalidate`, which only bumps the
+// generation, and the entries of an older generation are dropped at once by
+// the next access. A capacity of 0 disables the cache.
+//
+class Cache {
+public:
+  Cache();
+  ~Cache();
+
+  //
+  // ## Counters struct
+  //
+  struct Counters {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;                  /* entries dropped by the LRU */
+    uint64_t invalidations;              /* updates of the weights */
+    int size;                            /* entries of the current weights */
+    int capacity;
+  };
+
+  //
+  // ### resize
+  // Empties the cache and sets its capacity
+  // ```
+  // @capacity {int} max number of entries, 0 to disable the cache
+  // @in_size  {int} the input vectors size
+  // @out_size {int} the output vectors size
+  // ```
+  //
+  void resize(int, int, int);
+
+  //
+  // ### enabled
+  //
+  bool enabled() const {
+    return capacity_ > 0;
+  }
+
+  //
+  // ### generation
+  // ```
+  // @return {uint64_t} the generation of the weights, to read before running
+  //                    an input whose output is to be inserted
+  // ```
+  //
+  uint64_t generation() const {
+    return __sync_fetch_and_add(&generation_, 0);
+  }
+
+  //
+  // ### invalidate
+  // To call after every update of the weights
+  //
+  void invalidate() {
+    __sync_fetch_and_add(&generation_, 1);
+  }
+
+  //
+  // ### lookup
+  // ```
+  // @in  {const double*} the input vector
+  // @out {double*} filled with the cached output on hit
+  //
+  // @return {bool} whether the input was found
+  // ```
+  //
+  bool lookup(const double*, double*);
+
+  //
+  // ### insert
+  // Inserts (or refreshes) an entry, evicting the least recently used one
+  // when full. Ignored if the weights changed since `generation`.
+  // ```
+  // @in         {const double*} the input vector
+  // @out        {const double*} its output vector
+  // @generation {uint64_t} the `generation` read before running `in`
+  // ```
+  //
+  void insert(const double*, const double*, uint64_t);
+
+  //
+  // ### get_counters
+  // ```
+  // @counters {Counters} filled with a snapshot of the counters
+  // ```
+  //
+  void get_counters(Counters*);
+
+private:
+  Cache(Cache const&);
+  Cache& operator=(Cache const&);
+
+  //
+  // ## Entry struct
+  //
+  struct Entry {
+    uint64_t hash;
+    int chain;                           /* next entry of the bucket */
+    int prev;                            /* LRU list, most recent first */
+    int next;
+  };
+
+  static uint64_t hash(const double*, int);
+
+  int find(const double*, uint64_t) const;
+  void unlink(int);
+  void push_front(int);
+  void unchain(int);
+  void sync();
+
+  /**************************************************************************/
+  /*                              MEMBERS                                   */
+  /**************************************************************************/
+
+  mutable uv_mutex_t                 mutex_;
+
+  volatile int                       capacity_;
+  int                                in_size_;
+  int                                out_size_;
+
+  mutable volatile uint64_t          generation_; /* weights generation */
+  uint64_t                           synced_;    /* generation of the entries */
+  uint64_t                           base_;      /* generation at `resize` */
+
+  vector<Entry>                      entries_;
+  vector<double>                     data_;      /* inputs then outputs */
+  vector<int>                        buckets_;   /* power of 2 */
+  int                                size_;
+  int                                head_;      /* most recently used */
+  int                                tail_;      /* least recently used */
+
+  uint64_t                           hits_;
+  uint64_t                           misses_;
+  uint64_t                           evictions_;
+};
+
+#endif
@@ -0,0 +1,167 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef NN_FIXED_HH
+#define NN_FIXED_HH
+
+#include "nn.hh"
+#include "activation.hh"
+
+/******************************************************************************/
+/*                           FIXED TOPOLOGIES                                 */
+/******************************************************************************/
+
+//
+// Forward passes compiled for a few common small topologies. The layers sizes
+// are template parameters so that every loop is fully unrolled and the sums
+// are kept in registers. A Net whose layers match one of the registered shapes
+// uses it instead of the generic forward pass. The weights and values layouts
+// are the ones of `Net` (see `Net::alloc_layers`), computed at compile time.
+//
+namespace FIXED_NN {
+  //
+  // ### forward_t
+  // ```
+  // @W    {const T*} the weights block
+  // @B    {const T*} the bias weights block
+  // @bias {T} the bias value
+  // @act  {const int*} the layers activations
+  // @vals {T*} the neurons values: the input layer is read, the others written
+  // ```
+  //
+  template <typename T>
+  struct Kernel {
+    typedef void (*forward_t)(const T*, const T*, T, const int*, T*);
+  };
+
+  //
+  // ### pad
+  // A layer size rounded up to a NN_ALIGN boundary
+  //
+  template <typename T, int N>
+  struct Pad {
+    enum { A = NN_ALIGN / sizeof(T), value = (N + A - 1) / A * A };
+  };
+
+  //
+  // ### layer
+  // ```
+  // @W    {const T*} the layer weights, `OUT` rows of Pad<IN> values
+  // @B    {const T*} the layer bias weights
+  // @bias {T} the bias value
+  // @act  {int} the layer activation
+  // @in   {const T*} the previous layer values
+  // @out  {T*} the layer values
+  // ```
+  //
+  template <typename T, int IN, int OUT>
+  inline void layer(const T* W, const T* B, T bias, int act,
+                    const T* in, T* out)
+  {
+    T s[OUT > 0 ? OUT : 1];
+    for(int i = 0; i < OUT; i++) {
+      T a = bias * B[i];
+      for(int j = 0; j < IN; j++) {
+        a += W[i * Pad<T, IN>::value + j] * in[j];
+      }
+      s[i] = a;
+    }
+    ACT_NN::apply(act, s, out, OUT);
+  }
+
+  //
+  // ### forward
+  // Up to 5 layers: the trailing sizes of smaller networks are 0
+  //
+  template <typename T, int N0, int N1, int N2, int N3, int N4>
+  void forward(const T* W, const T* B, T bias, const int* act, T* vals)
+  {
+    enum {
+      O1 = Pad<T, N0>::value,
+      O2 = O1 + Pad<T, N1>::value,
+      O3 = O2 + Pad<T, N2>::value,
+      O4 = O3 + Pad<T, N3>::value,
+      W2 = N1 * Pad<T, N0>::value,
+      W3 = W2 + N2 * Pad<T, N1>::value,
+      W4 = W3 + N3 * Pad<T, N2>::value
+    };
+
+    layer<T, N0, N1>(W, B + O1, bias, act[1], vals, vals + O1);
+    if(N2 > 0) {
+      layer<T, N1, N2>(W + W2, B + O2, bias, act[2], vals + O1, vals + O2);
+    }
+    if(N3 > 0) {
+      layer<T, N2, N3>(W + W3, B + O3, bias, act[3], vals + O2, vals + O3);
+    }
+    if(N4 > 0) {
+      layer<T, N3, N4>(W + W4, B + O4, bias, act[4], vals + O3, vals + O4);
+    }
+  }
+
+  //
+  // ### SHAPES
+  // The registered topologies (add a line to compile a new one)
+  //
+#define FIXED_NN_SHAPES(X)                                                    \
+  X(1, 4, 3, 1, 0)                                                            \
+  X(2, 2, 1, 0, 0)                                                            \
+  X(2, 3, 1, 0, 0)                                                            \
+  X(2, 4, 1, 0, 0)                                                            \
+  X(2, 4, 4, 1, 0)                                                            \
+  X(3, 4, 1, 0, 0)                                                            \
+  X(4, 8, 1, 0, 0)                                                            \
+  X(4, 8, 3, 0, 0)                                                            \
+  X(8, 8, 1, 0, 0)                                                            \
+  X(8, 16, 1, 0, 0)                                                           \
+  X(16, 16, 1, 0, 0)
+
+  //
+  // ### lookup
+  // ```
+  // @layers {vector<int>} the layers structure
+  //
+  // @return {forward_t} the forward pass compiled for `layers`, NULL if the
+  //                     shape is not registered
+  // ```
+  //
+  template <typename T>
+  typename Kernel<T>::forward_t lookup(const vector<int>& layers)
+  {
+    int n[5] = { 0, 0, 0, 0, 0 };
+    if(layers.size() < 2 || layers.size() > 5) {
+      return NULL;
+    }
+    for(size_t l = 0; l < layers.size(); l++) {
+      n[l] = layers[l];
+    }
+
+#define FIXED_NN_LOOKUP(a, b, c, d, e)                                        \
+    if(n[0] == a && n[1] == b && n[2] == c && n[3] == d && n[4] == e) {       \
+      return &forward<T, a, b, c, d, e>;                                      \
+    }
+    FIXED_NN_SHAPES(FIXED_NN_LOOKUP)
+#undef FIXED_NN_LOOKUP
+
+    return NULL;
+  }
+};
+
+#endif
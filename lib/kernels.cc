@@ -0,0 +1,716 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "kernels.hh"
+
+#include <stddef.h>
+
+/* The vectorized kernels rely on the GCC/Clang `target` attribute so that   */
+/* the module itself can still be built for the baseline instruction set.    */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && \
+     (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SIMD_NN_X86 1
+#include <immintrin.h>
+#endif
+
+
+/******************************************************************************/
+/*                              SCALAR KERNELS                                */
+/******************************************************************************/
+
+//
+// ### dot_scalar
+//
+static double dot_scalar(const double* a, const double* b, int n)
+{
+  double s = 0;
+  for(int j = 0; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### axpy_scalar
+//
+static void axpy_scalar(double a, const double* x, double* y, int n)
+{
+  for(int j = 0; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+
+//
+// ### sdot_scalar
+//
+static float sdot_scalar(const float* a, const float* b, int n)
+{
+  float s = 0;
+  for(int j = 0; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### saxpy_scalar
+//
+static void saxpy_scalar(float a, const float* x, float* y, int n)
+{
+  for(int j = 0; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+//
+// ### gdot_scalar
+//
+static double gdot_scalar(const double* a, const uint32_t* idx,
+                          const double* b, int n)
+{
+  double s = 0;
+  for(int j = 0; j < n; j++) {
+    s += a[j] * b[idx[j]];
+  }
+  return s;
+}
+
+//
+// ### sgdot_scalar
+//
+static float sgdot_scalar(const float* a, const uint32_t* idx,
+                          const float* b, int n)
+{
+  float s = 0;
+  for(int j = 0; j < n; j++) {
+    s += a[j] * b[idx[j]];
+  }
+  return s;
+}
+
+
+/******************************************************************************/
+/*                                X86 KERNELS                                 */
+/******************************************************************************/
+
+#ifdef SIMD_NN_X86
+
+//
+// ### dot_sse2
+//
+__attribute__((target("sse2")))
+static double dot_sse2(const double* a, const double* b, int n)
+{
+  __m128d s0 = _mm_setzero_pd();
+  __m128d s1 = _mm_setzero_pd();
+  int j = 0;
+
+  for(; j + 4 <= n; j += 4) {
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + j),
+                                   _mm_loadu_pd(b + j)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + j + 2),
+                                   _mm_loadu_pd(b + j + 2)));
+  }
+  s0 = _mm_add_pd(s0, s1);
+
+  double r[2];
+  _mm_storeu_pd(r, s0);
+  double s = r[0] + r[1];
+  for(; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### axpy_sse2
+//
+__attribute__((target("sse2")))
+static void axpy_sse2(double a, const double* x, double* y, int n)
+{
+  __m128d va = _mm_set1_pd(a);
+  int j = 0;
+
+  for(; j + 2 <= n; j += 2) {
+    _mm_storeu_pd(y + j, _mm_add_pd(_mm_loadu_pd(y + j),
+                                    _mm_mul_pd(va, _mm_loadu_pd(x + j))));
+  }
+  for(; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+//
+// ### dot_avx2
+//
+__attribute__((target("avx2,fma")))
+static double dot_avx2(const double* a, const double* b, int n)
+{
+  __m256d s0 = _mm256_setzero_pd();
+  __m256d s1 = _mm256_setzero_pd();
+  __m256d s2 = _mm256_setzero_pd();
+  __m256d s3 = _mm256_setzero_pd();
+  int j = 0;
+
+  for(; j + 16 <= n; j += 16) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j),
+                         _mm256_loadu_pd(b + j), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 4),
+                         _mm256_loadu_pd(b + j + 4), s1);
+    s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 8),
+                         _mm256_loadu_pd(b + j + 8), s2);
+    s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 12),
+                         _mm256_loadu_pd(b + j + 12), s3);
+  }
+  for(; j + 4 <= n; j += 4) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j),
+                         _mm256_loadu_pd(b + j), s0);
+  }
+  s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+
+  __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0),
+                         _mm256_extractf128_pd(s0, 1));
+  h = _mm_add_sd(h, _mm_unpackhi_pd(h, h));
+  double s = _mm_cvtsd_f64(h);
+  for(; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### axpy_avx2
+//
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(double a, const double* x, double* y, int n)
+{
+  __m256d va = _mm256_set1_pd(a);
+  int j = 0;
+
+  for(; j + 8 <= n; j += 8) {
+    _mm256_storeu_pd(y + j, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j),
+                                            _mm256_loadu_pd(y + j)));
+    _mm256_storeu_pd(y + j + 4, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j + 4),
+                                                _mm256_loadu_pd(y + j + 4)));
+  }
+  for(; j + 4 <= n; j += 4) {
+    _mm256_storeu_pd(y + j, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j),
+                                            _mm256_loadu_pd(y + j)));
+  }
+  for(; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+//
+// ### gdot_avx2
+//
+__attribute__((target("avx2,fma")))
+static double gdot_avx2(const double* a, const uint32_t* idx,
+                        const double* b, int n)
+{
+  /* masked gathers, the plain ones reading an undefined source register */
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  __m256d s0 = _mm256_setzero_pd();
+  __m256d s1 = _mm256_setzero_pd();
+  int j = 0;
+
+  for(; j + 8 <= n; j += 8) {
+    __m128i i0 = _mm_loadu_si128((const __m128i*)(idx + j));
+    __m128i i1 = _mm_loadu_si128((const __m128i*)(idx + j + 4));
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j),
+                         _mm256_mask_i32gather_pd(_mm256_setzero_pd(), b, i0,
+                                                  all, 8), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 4),
+                         _mm256_mask_i32gather_pd(_mm256_setzero_pd(), b, i1,
+                                                  all, 8), s1);
+  }
+  s0 = _mm256_add_pd(s0, s1);
+
+  __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0),
+                         _mm256_extractf128_pd(s0, 1));
+  h = _mm_add_sd(h, _mm_unpackhi_pd(h, h));
+  double s = _mm_cvtsd_f64(h);
+  for(; j < n; j++) {
+    s += a[j] * b[idx[j]];
+  }
+  return s;
+}
+
+//
+// ### dot_avx512
+//
+__attribute__((target("avx512f")))
+static double dot_avx512(const double* a, const double* b, int n)
+{
+  __m512d s0 = _mm512_setzero_pd();
+  __m512d s1 = _mm512_setzero_pd();
+  int j = 0;
+
+  for(; j + 16 <= n; j += 16) {
+    s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j),
+                         _mm512_loadu_pd(b + j), s0);
+    s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j + 8),
+                         _mm512_loadu_pd(b + j + 8), s1);
+  }
+  if(j < n) {
+    /* masked tail: lanes past `n` are loaded as zero */
+    __mmask8 m = (__mmask8)((1u << (n - j < 8 ? n - j : 8)) - 1);
+    s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + j),
+                         _mm512_maskz_loadu_pd(m, b + j), s0);
+    j += 8;
+    if(j < n) {
+      m = (__mmask8)((1u << (n - j)) - 1);
+      s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + j),
+                           _mm512_maskz_loadu_pd(m, b + j), s1);
+    }
+  }
+  double r[8];
+  _mm512_storeu_pd(r, _mm512_add_pd(s0, s1));
+  return ((r[0] + r[1]) + (r[2] + r[3])) + ((r[4] + r[5]) + (r[6] + r[7]));
+}
+
+//
+// ### axpy_avx512
+//
+__attribute__((target("avx512f")))
+static void axpy_avx512(double a, const double* x, double* y, int n)
+{
+  __m512d va = _mm512_set1_pd(a);
+  int j = 0;
+
+  for(; j + 8 <= n; j += 8) {
+    _mm512_storeu_pd(y + j, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + j),
+                                            _mm512_loadu_pd(y + j)));
+  }
+  if(j < n) {
+    __mmask8 m = (__mmask8)((1u << (n - j)) - 1);
+    _mm512_mask_storeu_pd(y + j, m,
+                          _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(m, x + j),
+                                          _mm512_maskz_loadu_pd(m, y + j)));
+  }
+}
+
+//
+// ### sdot_sse2
+//
+__attribute__((target("sse2")))
+static float sdot_sse2(const float* a, const float* b, int n)
+{
+  __m128 s0 = _mm_setzero_ps();
+  __m128 s1 = _mm_setzero_ps();
+  int j = 0;
+
+  for(; j + 8 <= n; j += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + j),
+                                   _mm_loadu_ps(b + j)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + j + 4),
+                                   _mm_loadu_ps(b + j + 4)));
+  }
+  s0 = _mm_add_ps(s0, s1);
+
+  float r[4];
+  _mm_storeu_ps(r, s0);
+  float s = (r[0] + r[1]) + (r[2] + r[3]);
+  for(; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### saxpy_sse2
+//
+__attribute__((target("sse2")))
+static void saxpy_sse2(float a, const float* x, float* y, int n)
+{
+  __m128 va = _mm_set1_ps(a);
+  int j = 0;
+
+  for(; j + 4 <= n; j += 4) {
+    _mm_storeu_ps(y + j, _mm_add_ps(_mm_loadu_ps(y + j),
+                                    _mm_mul_ps(va, _mm_loadu_ps(x + j))));
+  }
+  for(; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+//
+// ### sdot_avx2
+//
+__attribute__((target("avx2,fma")))
+static float sdot_avx2(const float* a, const float* b, int n)
+{
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  __m256 s2 = _mm256_setzero_ps();
+  __m256 s3 = _mm256_setzero_ps();
+  int j = 0;
+
+  for(; j + 32 <= n; j += 32) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j),
+                         _mm256_loadu_ps(b + j), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 8),
+                         _mm256_loadu_ps(b + j + 8), s1);
+    s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 16),
+                         _mm256_loadu_ps(b + j + 16), s2);
+    s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 24),
+                         _mm256_loadu_ps(b + j + 24), s3);
+  }
+  for(; j + 8 <= n; j += 8) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j),
+                         _mm256_loadu_ps(b + j), s0);
+  }
+  s0 = _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3));
+
+  float r[8];
+  _mm256_storeu_ps(r, s0);
+  float s = ((r[0] + r[1]) + (r[2] + r[3])) + ((r[4] + r[5]) + (r[6] + r[7]));
+  for(; j < n; j++) {
+    s += a[j] * b[j];
+  }
+  return s;
+}
+
+//
+// ### saxpy_avx2
+//
+__attribute__((target("avx2,fma")))
+static void saxpy_avx2(float a, const float* x, float* y, int n)
+{
+  __m256 va = _mm256_set1_ps(a);
+  int j = 0;
+
+  for(; j + 16 <= n; j += 16) {
+    _mm256_storeu_ps(y + j, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j),
+                                            _mm256_loadu_ps(y + j)));
+    _mm256_storeu_ps(y + j + 8, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j + 8),
+                                                _mm256_loadu_ps(y + j + 8)));
+  }
+  for(; j + 8 <= n; j += 8) {
+    _mm256_storeu_ps(y + j, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j),
+                                            _mm256_loadu_ps(y + j)));
+  }
+  for(; j < n; j++) {
+    y[j] += a * x[j];
+  }
+}
+
+//
+// ### sgdot_avx2
+//
+__attribute__((target("avx2,fma")))
+static float sgdot_avx2(const float* a, const uint32_t* idx,
+                        const float* b, int n)
+{
+  const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  int j = 0;
+
+  for(; j + 16 <= n; j += 16) {
+    __m256i i0 = _mm256_loadu_si256((const __m256i*)(idx + j));
+    __m256i i1 = _mm256_loadu_si256((const __m256i*)(idx + j + 8));
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j),
+                         _mm256_mask_i32gather_ps(_mm256_setzero_ps(), b, i0,
+                                                  all, 4), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 8),
+                         _mm256_mask_i32gather_ps(_mm256_setzero_ps(), b, i1,
+                                                  all, 4), s1);
+  }
+  s0 = _mm256_add_ps(s0, s1);
+
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0),
+                        _mm256_extractf128_ps(s0, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+  float s = _mm_cvtss_f32(h);
+  for(; j < n; j++) {
+    s += a[j] * b[idx[j]];
+  }
+  return s;
+}
+
+//
+// ### sdot_avx512
+//
+__attribute__((target("avx512f")))
+static float sdot_avx512(const float* a, const float* b, int n)
+{
+  __m512 s0 = _mm512_setzero_ps();
+  __m512 s1 = _mm512_setzero_ps();
+  int j = 0;
+
+  for(; j + 32 <= n; j += 32) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + j),
+                         _mm512_loadu_ps(b + j), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + j + 16),
+                         _mm512_loadu_ps(b + j + 16), s1);
+  }
+  for(; j < n; j += 16) {
+    /* masked tail: lanes past `n` are loaded as zero */
+    __mmask16 m = (__mmask16)(n - j >= 16 ? 0xffff : (1u << (n - j)) - 1);
+    s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + j),
+                         _mm512_maskz_loadu_ps(m, b + j), s0);
+  }
+
+  float r[16];
+  _mm512_storeu_ps(r, _mm512_add_ps(s0, s1));
+  float s = 0;
+  for(int k = 0; k < 16; k++) {
+    s += r[k];
+  }
+  return s;
+}
+
+//
+// ### saxpy_avx512
+//
+__attribute__((target("avx512f")))
+static void saxpy_avx512(float a, const float* x, float* y, int n)
+{
+  __m512 va = _mm512_set1_ps(a);
+  int j = 0;
+
+  for(; j + 16 <= n; j += 16) {
+    _mm512_storeu_ps(y + j, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + j),
+                                            _mm512_loadu_ps(y + j)));
+  }
+  if(j < n) {
+    __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+    _mm512_mask_storeu_ps(y + j, m,
+                          _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + j),
+                                          _mm512_maskz_loadu_ps(m, y + j)));
+  }
+}
+
+#endif
+
+
+/******************************************************************************/
+/*                                 DISPATCH                                   */
+/******************************************************************************/
+
+//
+// ### get_dot
+//
+SIMD_NN::dot_t SIMD_NN::get_dot(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return dot_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return dot_sse2;
+      break;
+    case AVX2:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return dot_avx2;
+      break;
+    case AVX512:
+      if(__builtin_cpu_supports("avx512f"))
+        return dot_avx512;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### get_axpy
+//
+SIMD_NN::axpy_t SIMD_NN::get_axpy(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return axpy_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return axpy_sse2;
+      break;
+    case AVX2:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return axpy_avx2;
+      break;
+    case AVX512:
+      if(__builtin_cpu_supports("avx512f"))
+        return axpy_avx512;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### get_sdot
+//
+SIMD_NN::sdot_t SIMD_NN::get_sdot(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return sdot_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return sdot_sse2;
+      break;
+    case AVX2:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return sdot_avx2;
+      break;
+    case AVX512:
+      if(__builtin_cpu_supports("avx512f"))
+        return sdot_avx512;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### get_saxpy
+//
+SIMD_NN::saxpy_t SIMD_NN::get_saxpy(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return saxpy_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return saxpy_sse2;
+      break;
+    case AVX2:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return saxpy_avx2;
+      break;
+    case AVX512:
+      if(__builtin_cpu_supports("avx512f"))
+        return saxpy_avx512;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### get_gdot
+// There is no gather before AVX2, whose kernel is also used with AVX512
+//
+SIMD_NN::gdot_t SIMD_NN::get_gdot(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return gdot_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return gdot_scalar;
+      break;
+    case AVX2:
+    case AVX512:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return gdot_avx2;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### get_sgdot
+//
+SIMD_NN::sgdot_t SIMD_NN::get_sgdot(ISA isa)
+{
+  switch(isa) {
+    case SCALAR:
+      return sgdot_scalar;
+#ifdef SIMD_NN_X86
+    case SSE2:
+      if(__builtin_cpu_supports("sse2"))
+        return sgdot_scalar;
+      break;
+    case AVX2:
+    case AVX512:
+      if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return sgdot_avx2;
+      break;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+//
+// ### isa_name
+//
+const char* SIMD_NN::isa_name(ISA isa)
+{
+  switch(isa) {
+    case SCALAR: return "scalar";
+    case SSE2: return "sse2";
+    case AVX2: return "avx2";
+    case AVX512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+//
+// ### select
+// Picks the widest instruction set available on the running CPU
+//
+static SIMD_NN::ISA select()
+{
+#ifdef SIMD_NN_X86
+  __builtin_cpu_init();
+#endif
+  for(int i = SIMD_NN::ISA_COUNT - 1; i > SIMD_NN::SCALAR; i--) {
+    if(SIMD_NN::get_dot((SIMD_NN::ISA)i) != NULL) {
+      return (SIMD_NN::ISA)i;
+    }
+  }
+  return SIMD_NN::SCALAR;
+}
+
+/* Selected once, when the module is loaded */
+SIMD_NN::ISA SIMD_NN::isa = select();
+SIMD_NN::dot_t SIMD_NN::ddot = SIMD_NN::get_dot(SIMD_NN::isa);
+SIMD_NN::axpy_t SIMD_NN::daxpy = SIMD_NN::get_axpy(SIMD_NN::isa);
+SIMD_NN::sdot_t SIMD_NN::sdot = SIMD_NN::get_sdot(SIMD_NN::isa);
+SIMD_NN::saxpy_t SIMD_NN::saxpy = SIMD_NN::get_saxpy(SIMD_NN::isa);
+SIMD_NN::gdot_t SIMD_NN::dgdot = SIMD_NN::get_gdot(SIMD_NN::isa);
+SIMD_NN::sgdot_t SIMD_NN::sgdot = SIMD_NN::get_sgdot(SIMD_NN::isa);
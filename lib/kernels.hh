@@ -0,0 +1,158 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef NN_KERNELS_HH
+#define NN_KERNELS_HH
+
+#include <stdint.h>
+
+/******************************************************************************/
+/*                              SIMD KERNELS                                  */
+/******************************************************************************/
+
+//
+// The vectorized kernels are compiled for every instruction set supported by
+// the compiler and the best one available on the running CPU is selected once,
+// when the module is loaded. The scalar kernels are always available and are
+// used as a reference for the vectorized ones.
+//
+namespace SIMD_NN {
+  //
+  // ### ISA
+  //
+  enum ISA {
+    SCALAR = 0,
+    SSE2,
+    AVX2,
+    AVX512,
+    ISA_COUNT
+  };
+
+  //
+  // ### dot_t
+  // ```
+  // @a {const double*} first vector
+  // @b {const double*} second vector
+  // @n {int} vectors length
+  //
+  // @return {double} the dot product of `a` and `b`
+  // ```
+  //
+  typedef double (*dot_t)(const double*, const double*, int);
+
+  //
+  // ### axpy_t
+  // ```
+  // @a {double} scale factor
+  // @x {const double*} input vector
+  // @y {double*} accumulated vector: y += a * x
+  // @n {int} vectors length
+  // ```
+  //
+  typedef void (*axpy_t)(double, const double*, double*, int);
+
+  //
+  // ### sdot_t / saxpy_t
+  // Single precision versions of `dot_t` and `axpy_t`
+  //
+  typedef float (*sdot_t)(const float*, const float*, int);
+  typedef void (*saxpy_t)(float, const float*, float*, int);
+
+  //
+  // ### gdot_t / sgdot_t
+  // Dot product of a compressed row with a dense vector
+  // ```
+  // @a   {const double*|const float*} the row values
+  // @idx {const uint32_t*} their indices in `b`
+  // @b   {const double*|const float*} the dense vector
+  // @n   {int} number of values
+  // ```
+  //
+  typedef double (*gdot_t)(const double*, const uint32_t*, const double*, int);
+  typedef float (*sgdot_t)(const float*, const uint32_t*, const float*, int);
+
+  //
+  // ### ddot / daxpy / sdot / saxpy / dgdot / sgdot
+  // The kernels selected for the running CPU
+  //
+  extern dot_t ddot;
+  extern axpy_t daxpy;
+  extern sdot_t sdot;
+  extern saxpy_t saxpy;
+  extern gdot_t dgdot;
+  extern sgdot_t sgdot;
+
+  //
+  // ### dot / axpy
+  // Dispatch on the scalar type
+  //
+  inline double dot(const double* a, const double* b, int n) {
+    return ddot(a, b, n);
+  }
+  inline float dot(const float* a, const float* b, int n) {
+    return sdot(a, b, n);
+  }
+  inline void axpy(double a, const double* x, double* y, int n) {
+    daxpy(a, x, y, n);
+  }
+  inline void axpy(float a, const float* x, float* y, int n) {
+    saxpy(a, x, y, n);
+  }
+  inline double dot(const double* a, const uint32_t* idx, const double* b,
+                    int n) {
+    return dgdot(a, idx, b, n);
+  }
+  inline float dot(const float* a, const uint32_t* idx, const float* b,
+                   int n) {
+    return sgdot(a, idx, b, n);
+  }
+
+  //
+  // ### isa
+  // The instruction set of the selected kernels
+  //
+  extern ISA isa;
+
+  //
+  // ### get_dot / get_axpy / get_sdot / get_saxpy / get_gdot / get_sgdot
+  // ```
+  // @isa {ISA} the instruction set
+  //
+  // @return the kernel for `isa`, NULL if not available on this CPU
+  // ```
+  //
+  dot_t get_dot(ISA);
+  axpy_t get_axpy(ISA);
+  sdot_t get_sdot(ISA);
+  saxpy_t get_saxpy(ISA);
+  gdot_t get_gdot(ISA);
+  sgdot_t get_sgdot(ISA);
+
+  //
+  // ### isa_name
+  // ```
+  // @isa {ISA} the instruction set
+  // ```
+  //
+  const char* isa_name(ISA);
+};
+
+#endif
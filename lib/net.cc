@@ -0,0 +1,3168 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "net.hh"
+#include "kernels.hh"
+#include "activation.hh"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+
+/******************************************************************************/
+/*                          TRAINSET IMPLEMENTATION                           */
+/******************************************************************************/
+
+//
+// ### TrainSet
+//
+template <typename T>
+TrainSet<T>::TrainSet()
+{
+  size_ = 0;
+  in_dim_ = 0;
+  out_dim_ = 0;
+  in_stride_ = 0;
+  out_stride_ = 0;
+  shift_ = 0;
+  base_ = 0;
+  sparse_ = false;
+}
+
+//
+// ### ~TrainSet
+//
+template <typename T>
+TrainSet<T>::~TrainSet()
+{
+  this->clear();
+}
+
+//
+// ### init
+// Clears the set and sets the points dimensions
+// ```
+// @in_dim  {int} input vectors size
+// @out_dim {int} result vectors size
+// ```
+//
+template <typename T>
+void TrainSet<T>::init(int in_dim, int out_dim)
+{
+  this->clear();
+  in_dim_ = in_dim;
+  out_dim_ = out_dim;
+  in_stride_ = in_dim;
+  out_stride_ = out_dim;
+  this->layout();
+}
+
+//
+// ### layout
+// The numbers of points of the first and of the largest chunks are the largest
+// powers of 2 fitting in TRAIN_SET_FIRST_CHUNK and TRAIN_SET_CHUNK bytes (only
+// the results are chunked for sparse inputs)
+//
+template <typename T>
+void TrainSet<T>::layout()
+{
+  size_t point = std::max((sparse_ ? 0 : in_dim_) + out_dim_, 1) * sizeof(T);
+  shift_ = 0;
+  while(((size_t)2 << shift_) * point <= TRAIN_SET_CHUNK) {
+    shift_++;
+  }
+  base_ = 0;
+  while(base_ < shift_ &&
+        ((size_t)2 << base_) * point <= TRAIN_SET_FIRST_CHUNK) {
+    base_++;
+  }
+}
+
+//
+// ### append
+// Copies `n` packed points at the end of the set, allocating chunks as needed
+// ```
+// @in  {const T*} `n` packed input vectors
+// @out {const T*} `n` packed result vectors
+// @n   {size_t} number of points
+// ```
+//
+template <typename T>
+void TrainSet<T>::append(const T* in, const T* out, size_t n)
+{
+  if(blob_.data != NULL) {
+    cout << "Can't add points to a mapped training set" << endl;
+    return;
+  }
+
+  if(sparse_) {
+    vector<uint32_t> idx;
+    vector<T> val;
+    for(size_t p = 0; p < n; p++) {
+      const T* x = in + p * in_dim_;
+      idx.clear();
+      val.clear();
+      for(int j = 0; j < in_dim_; j++) {
+        if(x[j] != 0) {
+          idx.push_back(j);
+          val.push_back(x[j]);
+        }
+      }
+      this->append_sparse(idx.empty() ? NULL : &idx[0],
+                          val.empty() ? NULL : &val[0],
+                          (int)idx.size(), out + p * out_dim_);
+    }
+    return;
+  }
+
+  while(n > 0) {
+    size_t c = this->chunk(size_);
+    size_t end = this->first(c + 1);
+    if(c >= in_chunks_.size()) {
+      /* the points are copied in place: no need to zero the chunks */
+      size_t points = end - this->first(c);
+      in_chunks_.push_back(
+        (T*)NN::alloc(points * in_dim_ * sizeof(T), false));
+      out_chunks_.push_back(
+        (T*)NN::alloc(points * out_dim_ * sizeof(T), false));
+    }
+
+    /* copy as many points as the current chunk can take at once */
+    size_t k = std::min(n, end - size_);
+    memcpy((T*)this->in(size_), in, k * in_dim_ * sizeof(T));
+    memcpy((T*)this->out(size_), out, k * out_dim_ * sizeof(T));
+
+    in += k * in_dim_;
+    out += k * out_dim_;
+    size_ += k;
+    n -= k;
+  }
+}
+
+//
+// ### append_sparse
+// ```
+// @idx {const uint32_t*} sorted indices of the non-zero inputs
+// @val {const T*} their values
+// @nnz {int} number of non-zero inputs
+// @out {const T*} result vector
+// ```
+//
+template <typename T>
+void TrainSet<T>::append_sparse(const uint32_t* idx,
+                                const T* val,
+                                int nnz,
+                                const T* out)
+{
+  if(blob_.data != NULL) {
+    cout << "Can't add points to a mapped training set" << endl;
+    return;
+  }
+
+  if(!sparse_ && size_ > 0) {
+    vector<T> in(in_dim_, (T)0);
+    for(int k = 0; k < nnz; k++) {
+      in[idx[k]] = val[k];
+    }
+    this->append(&in[0], out, 1);
+    return;
+  }
+  if(!sparse_) {
+    sparse_ = true;
+    sp_ptr_.assign(1, 0);
+    this->layout();
+  }
+
+  size_t c = this->chunk(size_);
+  if(c >= out_chunks_.size()) {
+    size_t points = this->first(c + 1) - this->first(c);
+    out_chunks_.push_back(
+      (T*)NN::alloc(points * out_dim_ * sizeof(T), false));
+  }
+  memcpy((T*)this->out(size_), out, out_dim_ * sizeof(T));
+
+  sp_idx_.insert(sp_idx_.end(), idx, idx + nnz);
+  sp_val_.insert(sp_val_.end(), val, val + nnz);
+  sp_ptr_.push_back(sp_idx_.size());
+  size_++;
+}
+
+//
+// ### clear
+//
+template <typename T>
+void TrainSet<T>::clear()
+{
+  if(blob_.data != NULL) {
+    NN::blob_release(&blob_);
+  }
+  else {
+    for(size_t c = 0; c < in_chunks_.size(); c++) {
+      NN::release(in_chunks_[c]);
+    }
+    for(size_t c = 0; c < out_chunks_.size(); c++) {
+      NN::release(out_chunks_[c]);
+    }
+  }
+  in_chunks_.clear();
+  out_chunks_.clear();
+  in_stride_ = in_dim_;
+  out_stride_ = out_dim_;
+  size_ = 0;
+
+  if(sparse_) {
+    sparse_ = false;
+    sp_ptr_.clear();
+    sp_idx_.clear();
+    sp_val_.clear();
+    this->layout();
+  }
+}
+
+//
+// ### map
+// Replaces the set with the records of a file mapped read only
+// ```
+// @path {std::string} a file of packed `in_dim + out_dim` records
+// ```
+//
+template <typename T>
+bool TrainSet<T>::map(const std::string& path)
+{
+  this->clear();
+
+  size_t record = (size_t)(in_dim_ + out_dim_);
+  if(!NN::blob_load(path, true, &blob_, false)) {
+    return false;
+  }
+  if(record == 0 || blob_.size % (record * sizeof(T)) != 0) {
+    NN::blob_release(&blob_);
+    return false;
+  }
+
+  T* data = (T*)blob_.data;
+  size_ = blob_.size / (record * sizeof(T));
+  for(size_t c = 0; this->first(c) < size_; c++) {
+    size_t i = this->first(c);
+    in_chunks_.push_back(data + i * record);
+    out_chunks_.push_back(data + i * record + in_dim_);
+  }
+  in_stride_ = record;
+  out_stride_ = record;
+
+  return true;
+}
+
+//
+// ### prefetch
+// ```
+// @from {size_t} first point
+// @to   {size_t} end of the range
+// ```
+//
+template <typename T>
+void TrainSet<T>::prefetch(size_t from, size_t to)
+{
+  if(blob_.data == NULL || from >= to) {
+    return;
+  }
+  size_t record = (size_t)(in_dim_ + out_dim_) * sizeof(T);
+  NN::blob_prefetch(&blob_, from * record, (to - from) * record);
+}
+
+
+/******************************************************************************/
+/*                            NET IMPLEMENTATION                              */
+/******************************************************************************/
+
+//
+// ### Net
+// ```
+// @layers {vector<int>} the layers structure
+// @alpha  {T} the learning rate
+// @beta   {T} the momentum
+// @bias   {T} the bias value
+// @acts   {vector<int>} the activations of the layers but the input one,
+//                       sigmoid if empty
+// ```
+//
+template <typename T>
+Net<T>::Net(vector<int> &layers,
+            T alpha,
+            T beta,
+            T bias,
+            const vector<int>& acts)
+{
+  layers_ = layers;
+  alpha_ = alpha;
+  beta_ = beta;
+  bias_ = bias;
+  L_ = layers.size();
+  batch_size_ = 1;
+  pruned_ = false;
+  c_size_ = 0;
+
+  act_.assign(L_, ACT_NN::SIGMOID);
+  for(int l = 1; l < L_ && l - 1 < (int)acts.size(); l++) {
+    act_[l] = acts[l-1];
+  }
+
+  /* Layers initialization */
+  this->alloc_layers();
+  train_set_.init(layers_[0], layers_[L_-1]);
+
+  for(int l = 1; l < L_; l++) {
+    T* W = W_ + w_off_[l];
+    T* B = B_ + n_off_[l];
+
+    for(int i = 0; i < layers_[l]; i++) {
+      B[i] = (T)NN::fRand(0.2, 0.4);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        W[i * stride_[l] + j] = (T)NN::fRand(0.2, 0.4);
+      }
+    }
+  }
+}
+
+//
+// ### Net
+// ```
+// @str {std::string} the string representation of the network
+// ```
+//
+template <typename T>
+Net<T>::Net(std::string& str)
+{
+  istringstream iss(str);
+
+  iss >> L_;
+  layers_.resize(L_);
+
+  for(int i = 0; i < (int)layers_.size(); i ++) {
+    iss >> layers_[i];
+  }
+
+  iss >> alpha_;
+  iss >> beta_;
+  iss >> bias_;
+  batch_size_ = 1;
+  pruned_ = false;
+  c_size_ = 0;
+  act_.assign(L_, ACT_NN::SIGMOID);
+
+  /* Layers initialization */
+  this->alloc_layers();
+  train_set_.init(layers_[0], layers_[L_-1]);
+
+  for(int l = 1; l < L_; l++) {
+    T* W = W_ + w_off_[l];
+    T* B = B_ + n_off_[l];
+
+    for(int i = 0; i < layers_[l]; i++) {
+      iss >> B[i];
+      for(int j = 0; j < layers_[l-1]; j++) {
+        iss >> W[i * stride_[l] + j];
+      }
+    }
+  }
+
+  /* optional trailing tokens: `activations`, `pruned` then `float32` */
+  std::string token;
+  bool pruned = false;
+  bool mask = false;
+  vector<uint32_t> ptr;
+  vector<uint32_t> idx;
+  while(iss >> token) {
+    if(token == "activations") {
+      for(int l = 1; l < L_ && iss >> token; l++) {
+        int act = ACT_NN::parse(token);
+        if(act < 0) {
+          cout << "Unknown activation `" << token << "`" << endl;
+          act = ACT_NN::SIGMOID;
+        }
+        act_[l] = act;
+      }
+    }
+    if(token == "pruned") {
+      pruned = true;
+      mask = this->read_mask(iss, &ptr, &idx);
+    }
+  }
+
+  /* strings without a mask (older versions) wrote the removed weights as */
+  /* zeros, the only ones they keep removing                              */
+  if(mask) {
+    this->compress(ptr, idx);
+  }
+  else if(pruned) {
+    this->prune(0.0, -1.0);
+  }
+}
+
+//
+// ### read_mask
+// Reads the mask following the `pruned` token of a network string
+// ```
+// @iss {istream} the string, past the `pruned` token
+// @ptr {vector<uint32_t>} filled with the rows pointers
+// @idx {vector<uint32_t>} filled with the columns kept
+//
+// @return {bool} false if there is no mask or if it is inconsistent
+// ```
+//
+template <typename T>
+bool Net<T>::read_mask(istream& iss,
+                       vector<uint32_t>* ptr, vector<uint32_t>* idx)
+{
+  uint64_t kept = 0;
+  if(!(iss >> kept)) {
+    iss.clear();
+    return false;
+  }
+
+  /* never more than the dense weights, and the rows pointers are 32 bits */
+  uint64_t total = 0;
+  for(int l = 1; l < L_; l++) {
+    total += (uint64_t)layers_[l] * layers_[l-1];
+  }
+  bool valid = kept <= total && kept <= 0xffffffffULL;
+
+  ptr->assign(r_size_, 0);
+  idx->clear();
+  idx->reserve(valid ? (size_t)kept : 0);
+  for(int l = 1; l < L_ && valid; l++) {
+    for(int i = 0; i < layers_[l] && valid; i++) {
+      (*ptr)[r_off_[l] + i] = (uint32_t)idx->size();
+      int n = -1;
+      valid = (iss >> n) && n >= 0 && n <= layers_[l-1] &&
+              idx->size() + n <= kept;
+      for(int k = 0; k < n && valid; k++) {
+        int64_t j = -1;
+        valid = (iss >> j) && j >= 0 && j < layers_[l-1] &&
+                (k == 0 || (uint32_t)j > idx->back());
+        if(valid) {
+          idx->push_back((uint32_t)j);
+        }
+      }
+    }
+    (*ptr)[r_off_[l] + layers_[l]] = (uint32_t)idx->size();
+  }
+
+  if(!valid || idx->size() != kept) {
+    cout << "Invalid pruning mask" << endl;
+    iss.clear();
+    return false;
+  }
+  return true;
+}
+
+//
+// ### Net Copy constructor
+// ```
+// @nn <Net> the Net to copy
+// ```
+//
+template <typename T>
+Net<T>::Net(Net const& nn)
+  : NN()
+{
+  layers_ = vector<int>(nn.layers_);
+  act_ = nn.act_;
+  alpha_ = nn.alpha_;
+  beta_ = nn.beta_;
+  bias_ = nn.bias_;
+  L_ = int(layers_.size());
+  batch_size_ = nn.batch_size_;
+  pruned_ = nn.pruned_;
+  c_size_ = nn.c_size_;
+
+  this->alloc_layers();
+  train_set_.init(layers_[0], layers_[L_-1]);
+
+  /* Initialize values */
+  if(pruned_) {
+    memcpy(c_ptr_, nn.c_ptr_, r_size_ * sizeof(uint32_t));
+    memcpy(c_idx_, nn.c_idx_, c_size_ * sizeof(uint32_t));
+    flops_run_ = nn.flops_run_;
+    flops_train_ = nn.flops_train_;
+  }
+  memcpy(W_, nn.W_, w_size_ * sizeof(T));
+  if(nn.dW_ != NULL) {
+    memcpy(dW_, nn.dW_, w_size_ * sizeof(T));
+  }
+  memcpy(B_, nn.B_, n_size_ * sizeof(T));
+  memcpy(D_, nn.D_, n_size_ * sizeof(T));
+  memcpy(sum_, nn.sum_, n_size_ * sizeof(T));
+  memcpy(val_, nn.val_, n_size_ * sizeof(T));
+}
+
+//
+// ### Net
+// Empty network, used by `load`
+//
+template <typename T>
+Net<T>::Net()
+{
+  W_ = dW_ = B_ = NULL;
+  D_ = sum_ = val_ = NULL;
+  fixed_ = NULL;
+  pruned_ = false;
+  c_size_ = 0;
+  c_ptr_ = c_idx_ = NULL;
+  bval_ = bD_ = bG_ = NULL;
+  L_ = 0;
+  batch_size_ = 1;
+  batch_cap_ = 0;
+}
+
+//
+// ### ~Net
+//
+template <typename T>
+Net<T>::~Net()
+{
+  this->free_layers();
+};
+
+//
+// ### alloc_layers
+// Computes the layers offsets from `layers_` and allocates the zeroed, aligned
+// weights and neurons blocks. Every layer block and every weights row starts
+// on a NN_ALIGN boundary. When the network is loaded from a file (`blob_`), the
+// `W_` and `B_` blocks are set by `load` and `dW_` by `alloc_changes`.
+// The `W_` block of a pruned network holds the `c_size_` weights kept, its
+// rows pointers and columns being filled by the caller.
+//
+template <typename T>
+void Net<T>::alloc_layers()
+{
+  const size_t align = NN_ALIGN / sizeof(T);
+
+  stride_.assign(L_, 0);
+  w_off_.assign(L_, 0);
+  n_off_.assign(L_, 0);
+  w_size_ = 0;
+  n_size_ = 0;
+  flops_run_ = 0;
+  flops_train_ = 0;
+
+  for(int l = 0; l < L_; l++) {
+    n_off_[l] = n_size_;
+    n_size_ += (layers_[l] + align - 1) / align * align;
+
+    w_off_[l] = w_size_;
+    if(l > 0) {
+      stride_[l] = (layers_[l-1] + align - 1) / align * align;
+      w_size_ += (size_t)layers_[l] * stride_[l];
+
+      /* a multiply and an add by weight forward, the deltas of the inner */
+      /* layers backward, and 5 operations by weight update              */
+      uint64_t w = (uint64_t)layers_[l] * layers_[l-1];
+      flops_run_ += 2 * w;
+      flops_train_ += 2 * w + (l > 1 ? 2 * w : 0) + 5 * w;
+    }
+  }
+
+  /* rows pointers of the pruned layers */
+  r_off_.assign(L_, 0);
+  r_size_ = 0;
+  for(int l = 1; l < L_; l++) {
+    r_off_[l] = r_size_;
+    r_size_ += layers_[l] + 1;
+  }
+  if(pruned_) {
+    w_size_ = c_size_;
+  }
+
+  batch_cap_ = 0;
+  bval_ = NULL;
+  bD_ = NULL;
+  bG_ = NULL;
+
+  /* small networks of a registered shape use a compiled forward pass */
+  fixed_ = pruned_ ? NULL : FIXED_NN::lookup<T>(layers_);
+
+  uv_rwlock_init(&lock_);
+  uv_mutex_init(&gate_);
+  uv_mutex_init(&scratch_mutex_);
+
+  c_ptr_ = NULL;
+  c_idx_ = NULL;
+  if(blob_.data == NULL) {
+    W_ = (T*)NN::alloc(w_size_ * sizeof(T));
+    B_ = (T*)NN::alloc(n_size_ * sizeof(T));
+    if(pruned_) {
+      c_ptr_ = (uint32_t*)NN::alloc(r_size_ * sizeof(uint32_t));
+      c_idx_ = (uint32_t*)NN::alloc(c_size_ * sizeof(uint32_t));
+    }
+  }
+  /* mapped networks only allocate their changes once trained */
+  dW_ = blob_.data == NULL ? (T*)NN::alloc(w_size_ * sizeof(T)) : NULL;
+  D_ = (T*)NN::alloc(n_size_ * sizeof(T));
+  sum_ = (T*)NN::alloc(n_size_ * sizeof(T));
+  val_ = (T*)NN::alloc(n_size_ * sizeof(T));
+  state_sparse_ = false;
+}
+
+//
+// ### free_layers
+//
+template <typename T>
+void Net<T>::free_layers()
+{
+  if(blob_.data == NULL) {
+    NN::release(W_);
+    NN::release(B_);
+    NN::release(c_ptr_);
+    NN::release(c_idx_);
+  }
+  else {
+    NN::blob_release(&blob_);
+  }
+  NN::release(dW_);
+  NN::release(D_);
+  NN::release(sum_);
+  NN::release(val_);
+
+  NN::release(bval_);
+  NN::release(bD_);
+  NN::release(bG_);
+
+  for(size_t i = 0; i < scratch_.size(); i++) {
+    NN::release(scratch_[i]);
+  }
+  scratch_.clear();
+  uv_mutex_destroy(&scratch_mutex_);
+  uv_mutex_destroy(&gate_);
+  uv_rwlock_destroy(&lock_);
+}
+
+//
+// ### alloc_changes
+// Allocates the zeroed changes of a mapped network before it is first updated
+//
+template <typename T>
+void Net<T>::alloc_changes()
+{
+  if(dW_ == NULL) {
+    dW_ = (T*)NN::alloc(w_size_ * sizeof(T));
+  }
+}
+
+//
+// ### alloc_batch
+// Makes sure the mini-batch buffers can hold `n` samples
+// ```
+// @n {int} number of samples
+// ```
+//
+template <typename T>
+void Net<T>::alloc_batch(int n)
+{
+  if(n <= batch_cap_) {
+    return;
+  }
+  NN::release(bval_);
+  NN::release(bD_);
+  bval_ = (T*)NN::alloc((size_t)n * n_size_ * sizeof(T));
+  bD_ = (T*)NN::alloc((size_t)n * n_size_ * sizeof(T));
+
+  if(bG_ == NULL) {
+    /* gradients tile: at least one row of the widest layer */
+    size_t g_size = NN_BLOCK / sizeof(T);
+    for(int l = 1; l < L_; l++) {
+      g_size = std::max(g_size, (size_t)stride_[l]);
+    }
+    bG_ = (T*)NN::alloc(g_size * sizeof(T));
+  }
+  batch_cap_ = n;
+}
+
+//
+// ### run
+// ```
+// @in {vector<double>} input vector
+// ```
+//
+template <typename T>
+vector<double> Net<T>::run(vector<double> &in)
+{
+  /* initialization */
+  if(in.size() != (unsigned)layers_[0]) {
+    cout << "Incompatible Dimensions `in` (" << in.size() << ")" << endl;
+  }
+
+  uint64_t since = this->stats_clock();
+
+  /* cached outputs skip the forward pass (and leave `get_state` untouched) */
+  uint64_t generation = 0;
+  bool cache = this->cache_.enabled() && in.size() == (unsigned)layers_[0];
+  if(cache) {
+    vector<double> out(layers_[L_-1]);
+    generation = this->cache_.generation();
+    if(this->cache_.lookup(&in[0], &out[0])) {
+      this->stats_run(1, 0, since);
+      return out;
+    }
+  }
+
+  /* the values are kept for `get_state` */
+  this->write_lock();
+  T* val = val_ + n_off_[0];
+  for(int i = 0; i < layers_[0] && i < (int)in.size(); i++) {
+    val[i] = (T)in[i];
+  }
+  state_sparse_ = false;
+
+  this->forward(val_, sum_);
+
+  val = val_ + n_off_[L_-1];
+  vector<double> out(val, val + layers_[L_-1]);
+  this->write_unlock();
+
+  if(cache) {
+    this->cache_.insert(&in[0], &out[0], generation);
+  }
+
+  this->stats_run(1, flops_run_, since);
+
+  return out;
+}
+
+//
+// ### run_sparse
+// Only the first layer weights of the non-zero inputs are read
+// ```
+// @idx {vector<uint32_t>} indices of the non-zero inputs
+// @val {vector<double>} their values
+// ```
+//
+template <typename T>
+vector<double> Net<T>::run_sparse(vector<uint32_t> &idx,
+                                  vector<double> &val)
+{
+  if(!this->sparse_check(idx, val)) {
+    return vector<double>();
+  }
+
+  uint64_t since = this->stats_clock();
+  vector<T> x(val.begin(), val.end());
+  SparseInput<T> in;
+  in.idx = idx.empty() ? NULL : &idx[0];
+  in.val = x.empty() ? NULL : &x[0];
+  in.nnz = (int)idx.size();
+  in.prev = NULL;
+  in.n_prev = 0;
+
+  /* the values are kept for `get_state` */
+  this->write_lock();
+  T* in_val = val_ + n_off_[0];
+  if(state_sparse_) {
+    for(size_t k = 0; k < state_idx_.size(); k++) {
+      in_val[state_idx_[k]] = 0;
+    }
+  }
+  else {
+    memset(in_val, 0, layers_[0] * sizeof(T));
+  }
+  for(int k = 0; k < in.nnz; k++) {
+    in_val[in.idx[k]] = in.val[k];
+  }
+  state_idx_ = idx;
+  state_sparse_ = true;
+
+  /* pruned layers read the inputs of their weights kept */
+  uint64_t skipped = 0;
+  if(pruned_) {
+    this->forward(val_, sum_);
+  }
+  else {
+    this->forward_sparse(in, val_, sum_);
+    skipped = (uint64_t)(layers_[0] - in.nnz) * layers_[1];
+  }
+
+  const T* out_val = val_ + n_off_[L_-1];
+  vector<double> out(out_val, out_val + layers_[L_-1]);
+  this->write_unlock();
+
+  this->stats_run(1, flops_run_ - 2 * skipped, since);
+
+  return out;
+}
+
+//
+// ### sparse_check
+// Sorts a sparse input vector by index and sums the values of the duplicate
+// indices
+// ```
+// @idx {vector<uint32_t>} indices of the non-zero inputs
+// @val {vector<double>} their values
+//
+// @return {bool} false if the vector is not valid
+// ```
+//
+template <typename T>
+bool Net<T>::sparse_check(vector<uint32_t> &idx,
+                          vector<double> &val)
+{
+  if(idx.size() != val.size()) {
+    cout << "Incompatible Dimensions `indices` (" << idx.size() << ") and "
+         << "`values` (" << val.size() << ")" << endl;
+    return false;
+  }
+
+  vector< std::pair<uint32_t, double> > p(idx.size());
+  for(size_t k = 0; k < idx.size(); k++) {
+    p[k] = std::make_pair(idx[k], val[k]);
+  }
+  std::sort(p.begin(), p.end());
+
+  idx.clear();
+  val.clear();
+  for(size_t k = 0; k < p.size(); k++) {
+    if(p[k].first >= (uint32_t)layers_[0]) {
+      cout << "Incompatible Dimensions `indices` (" << p[k].first << ")"
+           << endl;
+      return false;
+    }
+    if(!idx.empty() && idx.back() == p[k].first) {
+      val.back() += p[k].second;
+    }
+    else {
+      idx.push_back(p[k].first);
+      val.push_back(p[k].second);
+    }
+  }
+
+  return true;
+}
+
+//
+// ### forward
+// Propagates the values of the input layer through the network
+// ```
+// @vals {T*} the neurons values, laid out as `val_`
+// @sums {T*} the neurons incoming sums, laid out as `sum_` (left untouched by
+//            the compiled forward passes, the sums being only kept in
+//            registers)
+// ```
+//
+template <typename T>
+void Net<T>::forward(T* vals, T* sums) const
+{
+  if(fixed_ != NULL) {
+    fixed_(W_, B_, bias_, &act_[0], vals);
+    return;
+  }
+
+  this->forward_from(1, vals, sums);
+}
+
+//
+// ### forward_from
+// The compressed rows of a pruned network only read the inputs of the weights
+// kept
+// ```
+// @first {int} the first layer to compute
+// @vals  {T*} the neurons values, laid out as `val_`
+// @sums  {T*} the neurons incoming sums, laid out as `sum_` (may be `vals`)
+// ```
+//
+template <typename T>
+void Net<T>::forward_from(int first, T* vals, T* sums) const
+{
+  for(int l = first; l < L_; l++) {
+    const T* B = B_ + n_off_[l];
+    const T* in_val = vals + n_off_[l-1];
+    T* sum = sums + n_off_[l];
+    T* val = vals + n_off_[l];
+
+    if(pruned_) {
+      const uint32_t* ptr = c_ptr_ + r_off_[l];
+      for(int i = 0; i < layers_[l]; i++) {
+        sum[i] = bias_ * B[i] +
+          SIMD_NN::dot(W_ + ptr[i], c_idx_ + ptr[i], in_val,
+                       (int)(ptr[i+1] - ptr[i]));
+      }
+    }
+    else {
+      const T* W = W_ + w_off_[l];
+      for(int i = 0; i < layers_[l]; i++) {
+        const T* w = W + (size_t)i * stride_[l];
+        sum[i] = bias_ * B[i] + SIMD_NN::dot(w, in_val, layers_[l-1]);
+      }
+    }
+    ACT_NN::apply(act_[l], sum, val, layers_[l]);
+  }
+}
+
+//
+// ### forward_sparse
+// Computes the first layer from the non-zero inputs only, then the next ones
+// as `forward` does. The input layer values are not read.
+// ```
+// @in   {SparseInput} the input vector
+// @vals {T*} the neurons values, laid out as `val_`
+// @sums {T*} the neurons incoming sums, laid out as `sum_`
+// ```
+//
+template <typename T>
+void Net<T>::forward_sparse(const SparseInput<T>& in, T* vals, T* sums) const
+{
+  const T* W = W_ + w_off_[1];
+  const T* B = B_ + n_off_[1];
+  T* sum = sums + n_off_[1];
+  T* val = vals + n_off_[1];
+
+  for(int i = 0; i < layers_[1]; i++) {
+    const T* w = W + (size_t)i * stride_[1];
+    T s = 0;
+    for(int k = 0; k < in.nnz; k++) {
+      s += w[in.idx[k]] * in.val[k];
+    }
+    sum[i] = bias_ * B[i] + s;
+  }
+  ACT_NN::apply(act_[1], sum, val, layers_[1]);
+
+  this->forward_from(2, vals, sums);
+}
+
+
+//
+// ### learn
+// ```
+// @in {vector<T>} input vector
+// @out {vector<T>} result vector
+// ```
+//
+template <typename T>
+vector<T> Net<T>::learn(vector<T> &in,
+                        vector<T> &out)
+{
+  if(in.size() != (unsigned)layers_[0]) {
+    cout << "Incompatible Dimensions `in` (" << in.size() << ")" << endl;
+  }
+  if(out.size() != (unsigned)layers_[L_-1]) {
+    cout << "Incompatible Dimensions `out` (" << out.size() << ")" << endl;
+  }
+
+  this->alloc_changes();
+  T* val = val_ + n_off_[0];
+  for(int i = 0; i < layers_[0] && i < (int)in.size(); i++) {
+    val[i] = in[i];
+  }
+  state_sparse_ = false;
+  this->forward(val_, sum_);
+  this->backward(&out[0], val_, D_);
+
+  val = val_ + n_off_[L_-1];
+  return vector<T>(val, val + layers_[L_-1]);
+}
+
+//
+// ### backward
+// Back propagates the error of the last forward pass and updates the weights.
+// For a sparse input, the first layer changes of the zero inputs are zero:
+// only the weights of its non-zero inputs and of the previous point ones (for
+// their momentum) are updated, which is exactly what a dense update does.
+// The first point of a range also applies the momentum of the other columns.
+// Pruned networks only update the weights kept, the sparse inputs being read
+// from `vals`.
+// ```
+// @out    {const T*} result vector
+// @vals   {const T*} the neurons values of the forward pass
+// @Ds     {T*} the neurons deltas
+// @sparse {SparseInput} the input vector, if sparse
+// ```
+//
+template <typename T>
+void Net<T>::backward(const T* out, const T* vals, T* Ds,
+                      const SparseInput<T>* sparse)
+{
+  T* D = Ds + n_off_[L_-1];
+  const T* val = vals + n_off_[L_-1];
+  for(int j = 0; j < layers_[L_-1]; j++) {
+    /* output layer */
+    D[j] = out[j] - val[j];
+  }
+  ACT_NN::derive(act_[L_-1], val, D, layers_[L_-1]);
+
+  for(int l = L_-2; l >= 0; l--) {
+    /* inner layer */
+    T* B = B_ + n_off_[l+1];
+    const T* D_next = Ds + n_off_[l+1];
+    D = Ds + n_off_[l];
+    val = vals + n_off_[l];
+
+    if(pruned_) {
+      /* compressed rows: the weights removed stay zero */
+      const uint32_t* ptr = c_ptr_ + r_off_[l+1];
+
+      for(int j = 0; j < layers_[l]; j++) {
+        D[j] = 0;
+      }
+      for(int i = 0; i < layers_[l+1]; i++) {
+        T d = D_next[i];
+
+        for(uint32_t k = ptr[i]; k < ptr[i+1]; k++) {
+          uint32_t j = c_idx_[k];
+          if(l > 0) {
+            D[j] += W_[k] * d;
+          }
+          /* weight update */
+          T delta = alpha_ * val[j] * d;
+
+          W_[k] += delta + beta_ * dW_[k];
+          dW_[k] = delta;
+        }
+
+        /* bias weight update */
+        B[i] = alpha_ * bias_ * d;
+      }
+
+      if(l > 0) {
+        ACT_NN::derive(act_[l], val, D, layers_[l]);
+      }
+      continue;
+    }
+
+    T* W = W_ + w_off_[l+1];
+    T* dW = dW_ + w_off_[l+1];
+
+    if(l == 0 && sparse != NULL) {
+      for(int i = 0; i < layers_[1]; i++) {
+        T* w = W + (size_t)i * stride_[1];
+        T* dw = dW + (size_t)i * stride_[1];
+        T d = D_next[i];
+
+        if(sparse->n_prev < 0) {
+          for(int j = 0; j < layers_[0]; j++) {
+            w[j] += beta_ * dw[j];
+            dw[j] = 0;
+          }
+        }
+        for(int k = 0; k < sparse->n_prev; k++) {
+          uint32_t j = sparse->prev[k];
+          w[j] += beta_ * dw[j];
+          dw[j] = 0;
+        }
+        for(int k = 0; k < sparse->nnz; k++) {
+          uint32_t j = sparse->idx[k];
+          T delta = alpha_ * sparse->val[k] * d;
+
+          w[j] += delta;
+          dw[j] = delta;
+        }
+
+        /* bias weight update */
+        B[i] = alpha_ * bias_ * d;
+      }
+      break;
+    }
+
+    for(int j = 0; j < layers_[l]; j++) {
+      D[j] = 0;
+    }
+
+    /* Rows of `W` are walked sequentially. Each weight is read for the delta */
+    /* before being updated, as the deltas use the weights of the last run.  */
+    for(int i = 0; i < layers_[l+1]; i++) {
+      T* w = W + (size_t)i * stride_[l+1];
+      T* dw = dW + (size_t)i * stride_[l+1];
+      T d = D_next[i];
+
+      for(int j = 0; j < layers_[l]; j++) {
+        if(l > 0) {
+          D[j] += w[j] * d;
+        }
+        /* weight update */
+        T delta = alpha_ * val[j] * d;
+
+        w[j] += delta + beta_ * dw[j];
+        dw[j] = delta;
+      }
+
+      /* bias weight update */
+      B[i] = alpha_ * bias_ * d;
+    }
+
+    if(l > 0) {
+      ACT_NN::derive(act_[l], val, D, layers_[l]);
+    }
+  }
+}
+
+//
+// ### forward_batch
+// Propagates the inputs of `n` samples through the network, one tile of weights
+// rows at a time
+// ```
+// @bval {T*} the samples values, laid out as `bval_`
+// @n    {int} number of samples
+// ```
+//
+template <typename T>
+void Net<T>::forward_batch(T* bval, int n) const
+{
+  if(fixed_ != NULL) {
+    for(int b = 0; b < n; b++) {
+      fixed_(W_, B_, bias_, &act_[0], bval + b * n_size_);
+    }
+    return;
+  }
+
+  for(int l = 1; l < L_ && pruned_; l++) {
+    /* tiles of compressed rows of about NN_BLOCK bytes */
+    const uint32_t* ptr = c_ptr_ + r_off_[l];
+    const T* B = B_ + n_off_[l];
+    const size_t row = sizeof(T) + sizeof(uint32_t);
+
+    for(int i0 = 0, i1 = 0; i0 < layers_[l]; i0 = i1) {
+      i1 = i0 + 1;
+      while(i1 < layers_[l] && (ptr[i1+1] - ptr[i0]) * row <= NN_BLOCK) {
+        i1++;
+      }
+      for(int b = 0; b < n; b++) {
+        const T* in_val = bval + b * n_size_ + n_off_[l-1];
+        T* val = bval + b * n_size_ + n_off_[l];
+
+        for(int i = i0; i < i1; i++) {
+          val[i] = bias_ * B[i] +
+            SIMD_NN::dot(W_ + ptr[i], c_idx_ + ptr[i], in_val,
+                         (int)(ptr[i+1] - ptr[i]));
+        }
+        ACT_NN::apply(act_[l], val + i0, val + i0, i1 - i0);
+      }
+    }
+  }
+  if(pruned_) {
+    return;
+  }
+
+  for(int l = 1; l < L_; l++) {
+    const T* W = W_ + w_off_[l];
+    const T* B = B_ + n_off_[l];
+    int tile = std::max(1, (int)(NN_BLOCK / (stride_[l] * sizeof(T))));
+
+    for(int i0 = 0; i0 < layers_[l]; i0 += tile) {
+      int i1 = std::min(layers_[l], i0 + tile);
+      for(int b = 0; b < n; b++) {
+        const T* in_val = bval + b * n_size_ + n_off_[l-1];
+        T* val = bval + b * n_size_ + n_off_[l];
+
+        for(int i = i0; i < i1; i++) {
+          val[i] = bias_ * B[i] +
+            SIMD_NN::dot(W + (size_t)i * stride_[l], in_val, layers_[l-1]);
+        }
+        ACT_NN::apply(act_[l], val + i0, val + i0, i1 - i0);
+      }
+    }
+  }
+}
+
+//
+// ### scratch_acquire
+// ```
+// @return {T*} a scratch buffer of NN_RUN_BATCH samples
+// ```
+//
+template <typename T>
+T* Net<T>::scratch_acquire() const
+{
+  T* s = NULL;
+
+  uv_mutex_lock(&scratch_mutex_);
+  if(!scratch_.empty()) {
+    s = scratch_.back();
+    scratch_.pop_back();
+  }
+  uv_mutex_unlock(&scratch_mutex_);
+
+  if(s == NULL) {
+    s = (T*)NN::alloc((size_t)NN_RUN_BATCH * n_size_ * sizeof(T));
+  }
+  return s;
+}
+
+//
+// ### scratch_release
+// Keeps up to NN_SCRATCH_POOL buffers for reuse
+// ```
+// @s {T*} a buffer returned by `scratch_acquire`
+// ```
+//
+template <typename T>
+void Net<T>::scratch_release(T* s) const
+{
+  uv_mutex_lock(&scratch_mutex_);
+  if(scratch_.size() < NN_SCRATCH_POOL) {
+    scratch_.push_back(s);
+    s = NULL;
+  }
+  uv_mutex_unlock(&scratch_mutex_);
+
+  NN::release(s);
+}
+
+//
+// ### read_lock / read_unlock
+// Readers go through the gate, which is held by a writer waiting for the lock
+//
+template <typename T>
+void Net<T>::read_lock() const
+{
+  uv_mutex_lock(&gate_);
+  uv_mutex_unlock(&gate_);
+  uv_rwlock_rdlock(&lock_);
+}
+
+template <typename T>
+void Net<T>::read_unlock() const
+{
+  uv_rwlock_rdunlock(&lock_);
+}
+
+//
+// ### write_lock / write_unlock
+//
+template <typename T>
+void Net<T>::write_lock() const
+{
+  uv_mutex_lock(&gate_);
+  uv_rwlock_wrlock(&lock_);
+  uv_mutex_unlock(&gate_);
+}
+
+template <typename T>
+void Net<T>::write_unlock() const
+{
+  uv_rwlock_wrunlock(&lock_);
+}
+
+//
+// ### run_packed
+// Runs `n` packed inputs by batches of NN_RUN_BATCH, converting them from and
+// to the scalar type `S` of the caller's buffers
+// ```
+// @in  {const S*} `n` packed input vectors
+// @out {S*} `n` packed output vectors
+// @n   {int} number of inputs
+// ```
+//
+template <typename T>
+template <typename S>
+void Net<T>::run_packed(const S* in, S* out, int n) const
+{
+  const int in_dim = layers_[0];
+  const int out_dim = layers_[L_-1];
+  uint64_t since = this->stats_clock();
+  T* bval = this->scratch_acquire();
+
+  this->read_lock();
+  for(int b0 = 0; b0 < n; b0 += NN_RUN_BATCH) {
+    int k = std::min(n - b0, NN_RUN_BATCH);
+
+    for(int b = 0; b < k; b++) {
+      const S* x = in + (size_t)(b0 + b) * in_dim;
+      T* val = bval + b * n_size_ + n_off_[0];
+      for(int j = 0; j < in_dim; j++) {
+        val[j] = (T)x[j];
+      }
+    }
+
+    this->forward_batch(bval, k);
+
+    for(int b = 0; b < k; b++) {
+      const T* val = bval + b * n_size_ + n_off_[L_-1];
+      S* y = out + (size_t)(b0 + b) * out_dim;
+      for(int j = 0; j < out_dim; j++) {
+        y[j] = (S)val[j];
+      }
+    }
+  }
+  this->read_unlock();
+
+  this->scratch_release(bval);
+  this->stats_run(n, flops_run_, since);
+}
+
+//
+// ### run_batch
+// ```
+// @in  {const double*} `n` packed input vectors
+// @out {double*} `n` packed output vectors
+// @n   {int} number of inputs
+// ```
+//
+template <typename T>
+void Net<T>::run_batch(const double* in, double* out, int n) const
+{
+  this->run_packed(in, out, n);
+}
+
+//
+// ### run_batch
+// ```
+// @in  {const float*} `n` packed input vectors
+// @out {float*} `n` packed output vectors
+// @n   {int} number of inputs
+// ```
+//
+template <typename T>
+void Net<T>::run_batch(const float* in, float* out, int n) const
+{
+  this->run_packed(in, out, n);
+}
+
+//
+// ### learn_batch
+// Runs the forward and backward passes over `n` samples at once and applies
+// the summed weights changes once. Each pass is a blocked matrix-matrix product
+// where a tile of weights rows is kept in cache while all the samples of the
+// batch go through it.
+// ```
+// @in  {const T**} `n` input vectors
+// @out {const T**} `n` result vectors
+// @n   {int} number of samples
+// ```
+//
+template <typename T>
+double Net<T>::learn_batch(const T** in,
+                       const T** out,
+                       int n)
+{
+  this->alloc_changes();
+  this->alloc_batch(n);
+
+  /* forward propagation */
+  for(int b = 0; b < n; b++) {
+    memcpy(bval_ + b * n_size_ + n_off_[0], in[b], layers_[0] * sizeof(T));
+  }
+  this->forward_batch(bval_, n);
+
+  /* output layer & error calculation */
+  double err = 0.0;
+  for(int b = 0; b < n; b++) {
+    const T* val = bval_ + b * n_size_ + n_off_[L_-1];
+    T* D = bD_ + b * n_size_ + n_off_[L_-1];
+    double e = 0;
+
+    for(int j = 0; j < layers_[L_-1]; j++) {
+      D[j] = out[b][j] - val[j];
+      e += (double)(val[j] - out[b][j]) * (val[j] - out[b][j]);
+    }
+    ACT_NN::derive(act_[L_-1], val, D, layers_[L_-1]);
+    err += e / layers_[L_-1];
+  }
+
+  /* back propagation */
+  for(int l = L_-2; l >= 0; l--) {
+    T* W = W_ + w_off_[l+1];
+    T* dW = dW_ + w_off_[l+1];
+    T* B = B_ + n_off_[l+1];
+    int tile = std::max(1, (int)(NN_BLOCK / (stride_[l+1] * sizeof(T))));
+
+    /* inner layer deltas, computed with the weights of the forward pass */
+    if(l > 0) {
+      for(int b = 0; b < n; b++) {
+        memset(bD_ + b * n_size_ + n_off_[l], 0, layers_[l] * sizeof(T));
+      }
+      for(int i0 = 0; i0 < layers_[l+1]; i0 += tile) {
+        int i1 = std::min(layers_[l+1], i0 + tile);
+        for(int b = 0; b < n; b++) {
+          const T* D_next = bD_ + b * n_size_ + n_off_[l+1];
+          T* D = bD_ + b * n_size_ + n_off_[l];
+
+          for(int i = i0; i < i1; i++) {
+            SIMD_NN::axpy(D_next[i], W + (size_t)i * stride_[l+1], D,
+                          layers_[l]);
+          }
+        }
+      }
+      for(int b = 0; b < n; b++) {
+        const T* val = bval_ + b * n_size_ + n_off_[l];
+        T* D = bD_ + b * n_size_ + n_off_[l];
+
+        ACT_NN::derive(act_[l], val, D, layers_[l]);
+      }
+    }
+
+    /* summed weights changes, one tile of rows at a time */
+    for(int i0 = 0; i0 < layers_[l+1]; i0 += tile) {
+      int i1 = std::min(layers_[l+1], i0 + tile);
+      memset(bG_, 0, (size_t)(i1 - i0) * stride_[l+1] * sizeof(T));
+
+      for(int b = 0; b < n; b++) {
+        const T* D_next = bD_ + b * n_size_ + n_off_[l+1];
+        const T* val = bval_ + b * n_size_ + n_off_[l];
+
+        for(int i = i0; i < i1; i++) {
+          SIMD_NN::axpy(alpha_ * D_next[i], val,
+                        bG_ + (size_t)(i - i0) * stride_[l+1], layers_[l]);
+        }
+      }
+
+      for(int i = i0; i < i1; i++) {
+        T* w = W + (size_t)i * stride_[l+1];
+        T* dw = dW + (size_t)i * stride_[l+1];
+        const T* g = bG_ + (size_t)(i - i0) * stride_[l+1];
+        T d = 0;
+
+        for(int j = 0; j < layers_[l]; j++) {
+          w[j] += g[j] + beta_ * dw[j];
+          dw[j] = g[j];
+        }
+
+        /* bias weight update */
+        for(int b = 0; b < n; b++) {
+          d += bD_[b * n_size_ + n_off_[l+1] + i];
+        }
+        B[i] = alpha_ * bias_ * d;
+      }
+    }
+  }
+
+  return err;
+}
+
+//
+// ### learn_step
+// Learn the current training set and return mean square error
+//
+template <typename T>
+double Net<T>::learn_step() {
+  return this->learn_range(train_set_, 0, train_set_.size());
+}
+
+//
+// ### learn_range
+// Learn the points `[from, to)` of the given training set and return their
+// summed mean square error. When `batch_size_` is greater than 1, the weights
+// are updated once per batch.
+// ```
+// @set  {TrainSet} the training set
+// @from {int} first point
+// @to   {int} end of the range
+// ```
+//
+template <typename T>
+double Net<T>::learn_range(TrainSet<T> &set, int from, int to)
+{
+  double err = 0.0;
+  this->alloc_changes();
+
+  /* sparse points are learnt one by one, as are the points of pruned */
+  /* networks                                                         */
+  if(set.sparse()) {
+    return this->learn_sparse(set, from, to, val_, sum_, D_);
+  }
+
+  if(batch_size_ > 1 && !pruned_) {
+    vector<const T*> in(batch_size_);
+    vector<const T*> out(batch_size_);
+
+    for(int i = from; i < to; i += batch_size_) {
+      int n = std::min(batch_size_, to - i);
+      for(int b = 0; b < n; b++) {
+        in[b] = set.in(i + b);
+        out[b] = set.out(i + b);
+      }
+      err += this->learn_batch(&in[0], &out[0], n);
+    }
+    return err;
+  }
+
+  T* in_val = val_ + n_off_[0];
+  const T* val = val_ + n_off_[L_-1];
+  state_sparse_ = false;
+  for(int i = from; i < to; i++) {
+    const T* out = set.out(i);
+
+    memcpy(in_val, set.in(i), layers_[0] * sizeof(T));
+    this->forward(val_, sum_);
+    this->backward(out, val_, D_);
+
+    /* error calculation */
+    double e = 0;
+    for(int j = 0; j < layers_[L_-1]; j++) {
+      e += (double)(val[j] - out[j]) * (val[j] - out[j]);
+    }
+    err += e / layers_[L_-1];
+  }
+
+  return err;
+}
+
+//
+// ### learn_sparse
+// Learns the points `[from, to)` of a sparse training set one by one. The
+// first layer changes may be non-zero anywhere when the range starts, so the
+// first point applies the momentum of all the columns.
+// Pruned networks rather set the non-zero inputs in `vals`, clearing the ones
+// of the previous point.
+// ```
+// @set  {TrainSet} the training set
+// @from {int} first point
+// @to   {int} end of the range
+// @vals {T*} the neurons values, laid out as `val_`
+// @sums {T*} the neurons incoming sums, laid out as `sum_`
+// @Ds   {T*} the neurons deltas, laid out as `D_`
+// ```
+//
+template <typename T>
+double Net<T>::learn_sparse(TrainSet<T> &set, int from, int to,
+                            T* vals, T* sums, T* Ds)
+{
+  double err = 0.0;
+  const T* val = vals + n_off_[L_-1];
+  T* in_val = vals + n_off_[0];
+
+  if(pruned_) {
+    memset(in_val, 0, layers_[0] * sizeof(T));
+    state_sparse_ = false;
+  }
+
+  SparseInput<T> in;
+  in.prev = NULL;
+  in.n_prev = -1;
+  for(int i = from; i < to; i++) {
+    const T* out = set.out(i);
+
+    in.idx = set.idx(i);
+    in.val = set.val(i);
+    in.nnz = set.nnz(i);
+    if(pruned_) {
+      for(int k = 0; k < in.n_prev; k++) {
+        in_val[in.prev[k]] = 0;
+      }
+      for(int k = 0; k < in.nnz; k++) {
+        in_val[in.idx[k]] = in.val[k];
+      }
+      this->forward(vals, sums);
+      this->backward(out, vals, Ds);
+    }
+    else {
+      this->forward_sparse(in, vals, sums);
+      this->backward(out, vals, Ds, &in);
+    }
+    in.prev = in.idx;
+    in.n_prev = in.nnz;
+
+    /* error calculation */
+    double e = 0;
+    for(int j = 0; j < layers_[L_-1]; j++) {
+      e += (double)(val[j] - out[j]) * (val[j] - out[j]);
+    }
+    err += e / layers_[L_-1];
+  }
+
+  return err;
+}
+
+//
+// ### flops_learn
+// ```
+// @return {uint64_t} the floating point operations by point learnt, the first
+//                    layer of a sparse set only costing its non-zero inputs
+// ```
+//
+template <typename T>
+uint64_t Net<T>::flops_learn() const
+{
+  if(pruned_ || !train_set_.sparse() || train_set_.size() == 0) {
+    return flops_train_;
+  }
+  uint64_t nnz = train_set_.nnz() / train_set_.size();
+  return flops_train_ - 7 * ((uint64_t)layers_[0] - nnz) * layers_[1];
+}
+
+
+//
+// ### train_set_add
+// ```
+// @in         {vector<double>} input vector
+// @out        {vector<double>} result vector to learn on
+// ```
+//
+template <typename T>
+void Net<T>::train_set_add(vector<double> &in,
+                           vector<double> &out)
+{
+  /* initialization */
+  if(in.size() != (unsigned)layers_[0]) {
+    cout << "Incompatible Dimensions `in` (" << in.size() << ")" << endl;
+    return;
+  }
+  if(out.size() != (unsigned)layers_[L_-1]) {
+    cout << "Incompatible Dimensions `out` (" << out.size() << ")" << endl;
+    return;
+  }
+
+  vector<T> i(in.begin(), in.end());
+  vector<T> o(out.begin(), out.end());
+  train_set_.append(&i[0], &o[0], 1);
+}
+
+//
+// ### train_set_add_sparse
+// ```
+// @idx {vector<uint32_t>} indices of the non-zero inputs
+// @val {vector<double>} their values
+// @out {vector<double>} result vector to learn on
+// ```
+//
+template <typename T>
+void Net<T>::train_set_add_sparse(vector<uint32_t> &idx,
+                                  vector<double> &val,
+                                  vector<double> &out)
+{
+  if(!this->sparse_check(idx, val)) {
+    return;
+  }
+  if(out.size() != (unsigned)layers_[L_-1]) {
+    cout << "Incompatible Dimensions `out` (" << out.size() << ")" << endl;
+    return;
+  }
+
+  vector<T> v(val.begin(), val.end());
+  vector<T> o(out.begin(), out.end());
+  train_set_.append_sparse(idx.empty() ? NULL : &idx[0],
+                           v.empty() ? NULL : &v[0],
+                           (int)idx.size(), &o[0]);
+}
+
+//
+// ### append_packed
+// Bulk append of packed points, converted from the scalar type `S` of the
+// caller's buffers by blocks of NN_BULK_CONVERT points when needed
+// ```
+// @in  {const S*} `n` packed input vectors
+// @out {const S*} `n` packed result vectors
+// @n   {size_t} number of points
+// ```
+//
+template <typename T>
+template <typename S>
+void Net<T>::append_packed(const S* in,
+                           const S* out,
+                           size_t n)
+{
+  if(sizeof(S) == sizeof(T)) {
+    train_set_.append((const T*)in, (const T*)out, n);
+    return;
+  }
+
+  const size_t in_dim = layers_[0];
+  const size_t out_dim = layers_[L_-1];
+  vector<T> i(NN_BULK_CONVERT * in_dim);
+  vector<T> o(NN_BULK_CONVERT * out_dim);
+
+  while(n > 0) {
+    size_t k = std::min(n, (size_t)NN_BULK_CONVERT);
+    std::copy(in, in + k * in_dim, i.begin());
+    std::copy(out, out + k * out_dim, o.begin());
+    train_set_.append(&i[0], &o[0], k);
+
+    in += k * in_dim;
+    out += k * out_dim;
+    n -= k;
+  }
+}
+
+//
+// ### train_set_add
+// ```
+// @in  {const double*} `n` packed input vectors
+// @out {const double*} `n` packed result vectors
+// @n   {size_t} number of points
+// ```
+//
+template <typename T>
+void Net<T>::train_set_add(const double* in,
+                           const double* out,
+                           size_t n)
+{
+  this->append_packed(in, out, n);
+}
+
+//
+// ### train_set_add
+// ```
+// @in  {const float*} `n` packed input vectors
+// @out {const float*} `n` packed result vectors
+// @n   {size_t} number of points
+// ```
+//
+template <typename T>
+void Net<T>::train_set_add(const float* in,
+                           const float* out,
+                           size_t n)
+{
+  this->append_packed(in, out, n);
+}
+
+//
+// ### train_set_clear
+//
+template <typename T>
+void Net<T>::train_set_clear()
+{
+  train_set_.clear();
+}
+
+//
+// ### train_set_mmap
+// ```
+// @path {std::string} a file of packed training records
+// ```
+//
+template <typename T>
+bool Net<T>::train_set_mmap(const std::string& path)
+{
+  return train_set_.map(path);
+}
+
+//
+// ### train
+// ```
+// @error      {double} target error
+// @iterations {int} max number of iterations
+// @batch_size {int} number of samples by weights update
+// ```
+//
+template <typename T>
+void Net<T>::train(double error,
+                   int iterations,
+                   int batch_size)
+{
+  if(log_) {
+    cout << "----------------------------------" << endl;
+    cout << "  LAYERS: [";
+    for(unsigned int i = 0; i < layers_.size(); i++) {
+      if(i > 0) cout << ", ";
+      cout << layers_[i];
+    }
+    cout << "]" << endl;
+    cout << "  ALPHA: " << alpha_ << endl;
+    cout << "  BETA: " << beta_ << endl;
+    cout << "  BIAS: " << bias_ << endl;
+    cout << "  TRAINING SIZE: " << train_set_.size() << endl;
+    cout << "  BATCH SIZE: " << batch_size << endl;
+    cout << "  ERROR THRESHOLD: " << error << endl;
+    cout << "  MAX ITERATIONS: " << iterations << endl;
+    cout << "----------------------------------" << endl;
+  }
+  int it = 0;
+  double err = 0;
+  batch_size_ = std::max(batch_size, 1);
+
+  do {
+    uint64_t since = this->stats_clock();
+    this->write_lock();
+    err = this->learn_step();
+    this->write_unlock();
+    this->cache_.invalidate();
+    this->stats_phase(NN::PHASE_TRAIN, since);
+    this->stats_train(train_set_.size(), this->flops_learn());
+    err /= train_set_.size();
+    it++;
+    if(log_) {
+      cout << "[" << it << "] " << err << endl;
+    }
+  } while(err > error && it < iterations);
+}
+
+//
+// ### mt_train
+// ```
+// @error      {double} target error
+// @iterations {int} max number of iterations
+// @step_size  {int} size of training set by step
+// @n_threads  {int} the number of threads to use
+// @batch_size {int} number of samples by weights update
+// @tune       {bool} whether to choose the step size and the number of
+//                    threads (up to `n_threads`) automatically, and to keep
+//                    adjusting the step size during the training
+// ```
+//
+template <typename T>
+void Net<T>::mt_train(double error,
+                      int iterations,
+                      int step_size,
+                      int thread,
+                      int batch_size,
+                      bool tune)
+{
+  int it = 0;
+  double err = 0.0;
+
+  int step = 0;
+  int total = 0;
+
+  /* replicas inherit the batch size */
+  batch_size_ = std::max(batch_size, 1);
+
+  if(log_) {
+    cout << "----------------------------------" << endl;
+    cout << "  STARTING MULTITHREAD TRAINING" << endl << endl;
+  }
+  if(train_set_.size() < 1) {
+    cout << "Training set is empty..." << endl;
+  }
+  else {
+    if(tune) {
+      this->mt_tune(std::max(thread, 1), &step_size, &thread);
+    }
+
+    if(log_) {
+      cout << "  STEP SIZE: " << step_size << (tune ? " (auto)" : "") << endl;
+      cout << "  NUMBER OF THREADS: " << thread << endl;
+      cout << "  BATCH SIZE: " << batch_size_ << endl << endl;
+      cout << "  ERROR THRESHOLD: " << error << endl;
+      cout << "  MAX ITERATIONS: " << iterations << endl << endl;
+      cout << "  ALPHA: " << alpha_ << endl;
+      cout << "  BETA: " << beta_ << endl;
+      cout << "  BIAS: " << bias_ << endl;
+      cout << "  TRAINING SIZE: " << train_set_.size() << endl;
+      cout << "----------------------------------" << endl;
+    }
+
+    /* Long lived learning threads, each one owning a replica of this Net */
+    /* and learning from its own shard of the training set                  */
+    uint64_t since = this->stats_clock();
+    MT_NN::Pool<T> pool;
+    MT_NN::pool_init(&pool, this, thread);
+    pool.train_set = &train_set_;
+    this->stats_phase(NN::PHASE_CLONE, since);
+
+    /* Main iteration loop */
+    double samples = 0.0;
+    do {
+      step = 0;
+      total = 0;
+      err = 0.0;
+      uint64_t start = uv_hrtime();
+      uint64_t learning = 0;
+
+      /* Step loop, left as soon as the training is cancelled */
+      while(total < (int)train_set_.size() && !this->cancelled()) {
+        since = this->stats_clock();
+        int added = MT_NN::split_data(&pool, step, step_size);
+        total += added;
+        this->stats_phase(NN::PHASE_SPLIT, since);
+
+        /* Resynchronize the replicas and wait until they are done learning */
+        since = this->stats_clock();
+        MT_NN::pool_run(&pool);
+        this->stats_phase(NN::PHASE_LEARN, since);
+        this->stats_train(added, this->flops_learn());
+
+        /* Compute result: the mean of the replicas, reduced in parallel */
+        since = this->stats_clock();
+        this->write_lock();
+        MT_NN::pool_merge(&pool);
+        this->write_unlock();
+        this->cache_.invalidate();
+        this->stats_phase(NN::PHASE_MERGE, since);
+        since = this->stats_clock();
+
+        /* look at error & it */
+        int total_training_size = 0;
+        uint64_t busy = 0;
+        for(int i = 0; i < thread; i++) {
+          if(pool.workers[i].from < pool.workers[i].to) {
+            err += pool.workers[i].error;
+            total_training_size += pool.workers[i].to - pool.workers[i].from;
+            busy = std::max(busy, pool.workers[i].busy);
+          }
+        }
+        learning += busy;
+        err /= total_training_size;
+        this->stats_phase(NN::PHASE_ERROR, since);
+
+        step++;
+      }
+      if(log_) {
+        cout << "[" << it << "] " << err << endl;
+      }
+      samples += total;
+      this->progress(it, err, samples);
+
+      /* Keep the time spent out of the learning itself (threads wake up, */
+      /* replicas synchronization and merge) between 5% and 15%           */
+      if(tune && total > 0) {
+        double wall = (double)(uv_hrtime() - start);
+        double overhead = wall - (double)learning;
+        int max_step = std::max((int)train_set_.size() / thread, 1);
+        int next = step_size;
+        if(overhead > 0.15 * wall) {
+          next = std::min(step_size * 2, max_step);
+        }
+        else if(overhead < 0.05 * wall) {
+          next = std::max(step_size / 2, 1);
+        }
+        if(log_ && next != step_size) {
+          cout << "  STEP SIZE: " << next << endl;
+        }
+        step_size = next;
+      }
+      it++;
+    } while(err > error && it < iterations && !this->cancelled());
+
+    MT_NN::pool_destroy(&pool);
+  }
+}
+
+//
+// ### mt_tune
+// Runs a few steps on a copy of the network for each candidate number of
+// threads (powers of 2 up to `max_threads`), with 2 different step sizes, to
+// measure the learning time of a point and the fixed cost of a step (threads
+// wake up, replicas synchronization and merge) on this topology. The step
+// size keeps that fixed cost around 10% of a step, and the number of threads
+// with the best resulting throughput is kept, fewer threads being preferred
+// unless more threads are at least 5% faster (they average more replicas).
+// ```
+// @max_threads {int} the maximum number of threads
+// @step_size   {int*} the chosen step size
+// @threads     {int*} the chosen number of threads
+// ```
+//
+template <typename T>
+void Net<T>::mt_tune(int max_threads,
+                     int* step_size,
+                     int* threads)
+{
+  int size = (int)train_set_.size();
+  double best = 0.0;
+
+  /* the steps only update the probe, the training set is shared */
+  Net<T> probe(*this);
+
+  for(int t = 1; ; t = std::min(t * 2, max_threads)) {
+    int s1 = std::min(256, size / t);
+    int s0 = s1 / 8;
+    if(s0 < 1) {
+      break;
+    }
+
+    MT_NN::Pool<T> pool;
+    MT_NN::pool_init(&pool, &probe, t);
+    pool.train_set = &train_set_;
+
+    /* best of 3 steps of `s0` then `s1` points by thread */
+    double time[2] = { 1e30, 1e30 };
+    for(int r = 0; r < 6; r++) {
+      int s = (r % 2 == 0) ? s0 : s1;
+      uint64_t start = uv_hrtime();
+      MT_NN::split_data(&pool, 0, s);
+      MT_NN::pool_run(&pool);
+      MT_NN::pool_merge(&pool);
+      time[r % 2] = std::min(time[r % 2], (uv_hrtime() - start) / 1e9);
+    }
+    MT_NN::pool_destroy(&pool);
+
+    double c = (time[1] - time[0]) / (s1 - s0);
+    if(c <= 0) {
+      c = time[1] / s1;
+    }
+    double o = std::max(time[0] - s0 * c, 0.0);
+    int step = (int)std::ceil(9 * o / c);
+    step = std::max(1, std::min(step, size / t));
+    double throughput = t * step / (step * c + o);
+
+    if(log_) {
+      cout << "  TUNING " << t << " THREADS: " << c * 1e6 << "us/point "
+           << o * 1e6 << "us/step STEP SIZE: " << step << endl;
+    }
+    if(throughput > best * 1.05) {
+      best = throughput;
+      *threads = t;
+      *step_size = step;
+    }
+
+    if(t == max_threads) {
+      break;
+    }
+  }
+}
+
+//
+// ### hogwild_train
+// Multithreaded train without replicas nor barrier: each thread learns its
+// own shard of the training set point by point, updating the shared weights
+// without any lock. The updates of the threads may overwrite each other,
+// which is harmless as long as the gradients are sparse or small enough.
+// ```
+// @error      {double} target error
+// @iterations {int} max number of iterations
+// @n_threads  {int} the number of threads to use
+// ```
+//
+template <typename T>
+void Net<T>::hogwild_train(double error,
+                           int iterations,
+                           int thread)
+{
+  if(log_) {
+    cout << "----------------------------------" << endl;
+    cout << "  STARTING HOGWILD TRAINING" << endl << endl;
+  }
+  if(train_set_.size() < 1) {
+    cout << "Training set is empty..." << endl;
+    return;
+  }
+  this->alloc_changes();
+
+  int size = (int)train_set_.size();
+  thread = std::max(1, std::min(thread, size));
+
+  if(log_) {
+    cout << "  NUMBER OF THREADS: " << thread << endl;
+    cout << "  ERROR THRESHOLD: " << error << endl;
+    cout << "  MAX ITERATIONS: " << iterations << endl << endl;
+    cout << "  ALPHA: " << alpha_ << endl;
+    cout << "  BETA: " << beta_ << endl;
+    cout << "  BIAS: " << bias_ << endl;
+    cout << "  TRAINING SIZE: " << size << endl;
+    cout << "----------------------------------" << endl;
+  }
+
+  MT_NN::Hogwild<T> hw;
+  hw.nn = this;
+  hw.iterations = iterations;
+  hw.stop = false;
+  hw.done = 0;
+  uv_mutex_init(&hw.mutex);
+  uv_cond_init(&hw.progress);
+
+  vector< MT_NN::HogwildWorker<T> > workers(thread);
+  vector<uv_thread_t> ids(thread);
+
+  /* Each thread keeps the same contiguous shard and its own activations */
+  for(int i = 0; i < thread; i++) {
+    MT_NN::HogwildWorker<T>* worker = &workers[i];
+    worker->hw = &hw;
+    worker->from = (int)((long long)size * i / thread);
+    worker->to = (int)((long long)size * (i + 1) / thread);
+    worker->buf = (T*)NN::alloc(3 * n_size_ * sizeof(T));
+    worker->error = 0.0;
+    worker->epochs = 0;
+  }
+  uint64_t since = this->stats_clock();
+  this->cache_.invalidate();
+  for(int i = 0; i < thread; i++) {
+    uv_thread_create(&ids[i], MT_NN::hogwild<T>, &workers[i]);
+  }
+
+  /* Watch the convergence: the error of an iteration is known once every  */
+  /* thread is done with it, but the threads never wait for each other     */
+  int it = 0;
+  uv_mutex_lock(&hw.mutex);
+  while(hw.done < thread) {
+    uv_cond_wait(&hw.progress, &hw.mutex);
+
+    /* the weights change continuously: outputs are cached for an epoch */
+    this->cache_.invalidate();
+
+    int epochs = workers[0].epochs;
+    double err = 0.0;
+    for(int i = 0; i < thread; i++) {
+      epochs = std::min(epochs, workers[i].epochs);
+      err += workers[i].error;
+    }
+    err /= size;
+
+    if(epochs > it) {
+      it = epochs;
+      if(log_) {
+        cout << "[" << it - 1 << "] " << err << endl;
+      }
+      this->progress(it - 1, err, (double)it * size);
+      if(err <= error) {
+        hw.stop = true;
+      }
+    }
+    if(this->cancelled()) {
+      hw.stop = true;
+    }
+  }
+  uv_mutex_unlock(&hw.mutex);
+
+  uint64_t samples = 0;
+  for(int i = 0; i < thread; i++) {
+    uv_thread_join(&ids[i]);
+    NN::release(workers[i].buf);
+    samples += (uint64_t)workers[i].epochs * (workers[i].to - workers[i].from);
+  }
+  this->cache_.invalidate();
+  this->stats_phase(NN::PHASE_LEARN, since);
+  this->stats_train(samples, this->flops_learn());
+
+  uv_cond_destroy(&hw.progress);
+  uv_mutex_destroy(&hw.mutex);
+}
+
+//
+// ### learn_shared
+// Learns the points `[from, to)` of the training set one by one like
+// `learn_range`, but keeps the activations in the given buffer so that any
+// number of threads can learn at once on the same weights
+// ```
+// @from {int} first point
+// @to   {int} end of the range
+// @buf  {T*} 3 neurons blocks: values, incoming sums and deltas
+//
+// @return {double} the summed mean square error
+// ```
+//
+template <typename T>
+double Net<T>::learn_shared(int from, int to, T* buf)
+{
+  T* vals = buf;
+  T* sums = buf + n_size_;
+  T* Ds = buf + 2 * n_size_;
+  double err = 0.0;
+
+  if(train_set_.sparse()) {
+    return this->learn_sparse(train_set_, from, to, vals, sums, Ds);
+  }
+
+  T* in_val = vals + n_off_[0];
+  const T* val = vals + n_off_[L_-1];
+  for(int i = from; i < to; i++) {
+    const T* out = train_set_.out(i);
+
+    memcpy(in_val, train_set_.in(i), layers_[0] * sizeof(T));
+    this->forward(vals, sums);
+    this->backward(out, vals, Ds);
+
+    /* error calculation */
+    double e = 0;
+    for(int j = 0; j < layers_[L_-1]; j++) {
+      e += (double)(val[j] - out[j]) * (val[j] - out[j]);
+    }
+    err += e / layers_[L_-1];
+  }
+
+  return err;
+}
+
+//
+// ### sync
+// Copies the weights, changes and parameters of `nn` in place. Both Nets must
+// share the same layers.
+// ```
+// @nn {Net} the Net to copy the weights from
+// ```
+//
+template <typename T>
+void Net<T>::sync(Net const& nn)
+{
+  assert(w_size_ == nn.w_size_ && n_size_ == nn.n_size_);
+
+  alpha_ = nn.alpha_;
+  beta_ = nn.beta_;
+  bias_ = nn.bias_;
+  batch_size_ = nn.batch_size_;
+
+  this->alloc_changes();
+  memcpy(W_, nn.W_, w_size_ * sizeof(T));
+  if(nn.dW_ != NULL) {
+    memcpy(dW_, nn.dW_, w_size_ * sizeof(T));
+  }
+  else {
+    memset(dW_, 0, w_size_ * sizeof(T));
+  }
+  memcpy(B_, nn.B_, n_size_ * sizeof(T));
+}
+
+//
+// ### precision
+//
+template <typename T>
+const char* Net<T>::precision()
+{
+  return sizeof(T) == sizeof(float) ? "float32" : "float64";
+}
+
+//
+// ### to_string
+// Single precision networks are tagged with a trailing `float32` token, which
+// is ignored when reading a double precision network. Pruned networks are
+// written dense and tagged with a `pruned` token followed by their mask.
+//
+template <typename T>
+std::string Net<T>::to_string()
+{
+  ostringstream oss;
+
+  oss << (int)layers_.size();
+
+  for(int i = 0; i < (int)layers_.size(); i ++) {
+    oss << " " << layers_[i];
+  }
+
+  oss << " " << alpha_;
+  oss << " " << beta_;
+  oss << " " << bias_;
+
+  for(int l = 1; l < L_; l++) {
+    const T* B = B_ + n_off_[l];
+    vector<T> w(layers_[l-1]);
+
+    for(int i = 0; i < layers_[l]; i++) {
+      oss << " " << B[i];
+      this->expand_row(l, i, &w[0], NULL);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        oss << " " << w[j];
+      }
+    }
+  }
+
+  /* the activations are only written when they are not all sigmoid, so */
+  /* that these strings can still be read by older versions             */
+  bool sigmoid = true;
+  for(int l = 1; l < L_; l++) {
+    sigmoid = sigmoid && act_[l] == ACT_NN::SIGMOID;
+  }
+  if(!sigmoid) {
+    oss << " activations";
+    for(int l = 1; l < L_; l++) {
+      oss << " " << ACT_NN::name(act_[l]);
+    }
+  }
+
+  /* the weights removed are written as zeros, then the mask: the number */
+  /* of weights kept followed, row by row, by the count and the columns  */
+  if(pruned_) {
+    oss << " pruned " << c_size_;
+    for(int l = 1; l < L_; l++) {
+      const uint32_t* ptr = c_ptr_ + r_off_[l];
+      for(int i = 0; i < layers_[l]; i++) {
+        oss << " " << ptr[i+1] - ptr[i];
+        for(uint32_t k = ptr[i]; k < ptr[i+1]; k++) {
+          oss << " " << c_idx_[k];
+        }
+      }
+    }
+  }
+
+  if(sizeof(T) == sizeof(float)) {
+    oss << " " << this->precision();
+  }
+
+  return oss.str();
+}
+
+//
+// ### get_state
+//
+template <typename T>
+std::string Net<T>::get_state(bool compact)
+{
+  ostringstream oss;
+
+  oss << (int)layers_.size();
+
+  for(int i = 0; i < (int)layers_.size(); i++) {
+    oss << " " << layers_[i];
+  }
+
+  if(compact)
+    oss << " " << "compact";
+  else
+    oss << " " << "full";
+
+  for(int l = 1; l < L_; l++) {
+    const T* val = val_ + n_off_[l-1];
+    vector<T> w(layers_[l-1]);
+
+    for(int i = 0; i < layers_[l]; i++) {
+      this->expand_row(l, i, &w[0], NULL);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        T s = w[j] * val[j];
+        if(!compact) {
+          oss << " " << s;
+        }
+        else if(s != 0.0) {
+          oss << " " << l
+              << " " << i
+              << " " << j
+              << " " << s;
+        }
+      }
+    }
+  }
+
+  return oss.str();
+}
+
+//
+// ### save
+// Writes the header, the layers then the `B_` and `W_` blocks as they are laid
+// out in memory, followed by the rows pointers and columns of a pruned network.
+// Dense networks are still written as version 2 files.
+// ```
+// @path {std::string} the file path
+// ```
+//
+template <typename T>
+bool Net<T>::save(const std::string& path)
+{
+  NetHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, NET_MAGIC, sizeof(h.magic));
+  h.version = pruned_ ? NET_VERSION : 2;
+  h.flags = pruned_ ? NET_PRUNED : 0;
+  h.scalar = sizeof(T);
+  h.align = NN_ALIGN;
+  h.L = L_;
+  h.alpha = alpha_;
+  h.beta = beta_;
+  h.bias = bias_;
+  h.n_size = n_size_;
+  h.w_size = w_size_;
+  h.data = (sizeof(h) + 2 * L_ * sizeof(uint32_t) + NN_ALIGN - 1) /
+    NN_ALIGN * NN_ALIGN;
+
+  vector<char> head(h.data, 0);
+  memcpy(&head[0], &h, sizeof(h));
+  uint32_t* layers = (uint32_t*)(&head[0] + sizeof(h));
+  for(int l = 0; l < L_; l++) {
+    layers[l] = layers_[l];
+    layers[L_ + l] = act_[l];
+  }
+
+  FILE* f = fopen(path.c_str(), "wb");
+  if(f == NULL) {
+    return false;
+  }
+  bool ok = fwrite(&head[0], 1, head.size(), f) == head.size() &&
+    fwrite(B_, sizeof(T), n_size_, f) == n_size_ &&
+    fwrite(W_, sizeof(T), w_size_, f) == w_size_;
+  if(pruned_) {
+    ok = ok &&
+      fwrite(c_ptr_, sizeof(uint32_t), r_size_, f) == r_size_ &&
+      fwrite(c_idx_, sizeof(uint32_t), c_size_, f) == c_size_;
+  }
+  ok = (fclose(f) == 0) && ok;
+
+  return ok;
+}
+
+//
+// ### load
+// Builds a network using the `B_` and `W_` blocks (and the rows pointers and
+// columns of a pruned network) of `blob` in place
+// ```
+// @blob {NN::Blob} a binary network file
+// ```
+//
+template <typename T>
+Net<T>* Net<T>::load(NN::Blob& blob)
+{
+  const NetHeader* h = (const NetHeader*)blob.data;
+  /* version 1 files have no activations: all the layers are sigmoid */
+  size_t arrays = h->version >= 2 ? 2 : 1;
+  bool pruned = h->version >= 3 && (h->flags & NET_PRUNED) != 0;
+  if(h->L < 2 || h->data > blob.size ||
+     sizeof(*h) + arrays * h->L * sizeof(uint32_t) > h->data ||
+     (pruned && h->w_size > 0xffffffffULL)) {
+    return NULL;
+  }
+  const uint32_t* layers = (const uint32_t*)(blob.data + sizeof(*h));
+
+  vector<int> acts(h->L, ACT_NN::SIGMOID);
+  for(uint32_t l = 1; arrays == 2 && l < h->L; l++) {
+    if(layers[h->L + l] >= ACT_NN::ACTIVATION_COUNT) {
+      return NULL;
+    }
+    acts[l] = layers[h->L + l];
+  }
+
+  /* the blocks sizes are computed as `alloc_layers` does and checked */
+  /* against the file before anything is allocated                    */
+  const uint64_t align = NN_ALIGN / sizeof(T);
+  const uint64_t limit = blob.size / sizeof(T);
+  uint64_t n_size = 0;
+  uint64_t w_size = 0;
+  uint64_t r_size = 0;
+  for(uint32_t l = 0; l < h->L; l++) {
+    if(layers[l] < 1 || layers[l] > INT_MAX) {
+      return NULL;
+    }
+    n_size += (layers[l] + align - 1) / align * align;
+    if(l > 0) {
+      uint64_t stride = (layers[l-1] + align - 1) / align * align;
+      w_size += (uint64_t)layers[l] * stride;
+      r_size += (uint64_t)layers[l] + 1;
+    }
+    /* the weights of a pruned network are not stored dense */
+    if(n_size > limit || r_size > limit || (!pruned && w_size > limit)) {
+      return NULL;
+    }
+  }
+  uint64_t bytes = (n_size + h->w_size) * sizeof(T) +
+    (pruned ? (r_size + h->w_size) * sizeof(uint32_t) : 0);
+  if(h->n_size != n_size || (!pruned && h->w_size != w_size) ||
+     h->data % NN_ALIGN != 0 || bytes > blob.size - h->data) {
+    return NULL;
+  }
+
+  Net<T>* nn = new Net<T>();
+  nn->layers_.assign(layers, layers + h->L);
+  nn->act_ = acts;
+  nn->L_ = h->L;
+  nn->alpha_ = (T)h->alpha;
+  nn->beta_ = (T)h->beta;
+  nn->bias_ = (T)h->bias;
+  nn->pruned_ = pruned;
+  nn->c_size_ = pruned ? (size_t)h->w_size : 0;
+
+  nn->blob_ = blob;
+  nn->alloc_layers();
+
+  nn->B_ = (T*)(blob.data + h->data);
+  nn->W_ = nn->B_ + nn->n_size_;
+
+  if(pruned) {
+    nn->c_ptr_ = (uint32_t*)(nn->W_ + nn->w_size_);
+    nn->c_idx_ = nn->c_ptr_ + nn->r_size_;
+    if(!nn->check_pruned()) {
+      /* the blob is released by the caller */
+      nn->blob_ = NN::Blob();
+      nn->W_ = nn->B_ = NULL;
+      nn->c_ptr_ = nn->c_idx_ = NULL;
+      delete nn;
+      return NULL;
+    }
+    nn->flops_pruned();
+  }
+  nn->train_set_.init(nn->layers_[0], nn->layers_[nn->L_-1]);
+
+  return nn;
+}
+
+//
+// ### NN::load
+// Reads the header of the file to pick the precision of the network
+// ```
+// @path {std::string} the file path
+// @map  {bool} whether to mmap the weights rather than reading them
+// ```
+//
+NN* NN::load(const std::string& path, bool map)
+{
+  NN::Blob blob;
+  if(!NN::blob_load(path, map, &blob)) {
+    return NULL;
+  }
+
+  NN* nn = NULL;
+  const NetHeader* h = (const NetHeader*)blob.data;
+  if(blob.size >= sizeof(*h) &&
+     memcmp(h->magic, NET_MAGIC, sizeof(h->magic)) == 0 &&
+     h->version >= 1 && h->version <= NET_VERSION &&
+     h->align == NN_ALIGN) {
+    if(h->scalar == sizeof(float)) {
+      nn = Net<float>::load(blob);
+    }
+    else if(h->scalar == sizeof(double)) {
+      nn = Net<double>::load(blob);
+    }
+  }
+
+  if(nn == NULL) {
+    NN::blob_release(&blob);
+  }
+  return nn;
+}
+
+
+/******************************************************************************/
+/*                                  PRUNING                                   */
+/******************************************************************************/
+
+//
+// ### prune
+// Removes the weights of smallest magnitude and stores the layers as
+// compressed rows. With a `sparsity`, that fraction of the weights of each
+// layer (counting the ones already removed) is removed, otherwise the weights
+// of magnitude up to `threshold`; zero weights are always removed. The weights
+// removed are never updated again, so that training a pruned network
+// fine-tunes it with a fixed mask. A mapped network is read in memory.
+// ```
+// @threshold {double} magnitude up to which the weights are removed
+// @sparsity  {double} fraction of the weights of each layer to remove
+//                     instead, if not negative
+//
+// @return {double} the fraction of the weights removed, -1 on error
+// ```
+//
+template <typename T>
+double Net<T>::prune(double threshold, double sparsity)
+{
+  if(sparsity >= 1.0 || (sparsity < 0.0 && threshold < 0.0)) {
+    cout << "Invalid pruning `threshold` (" << threshold << ") or "
+         << "`sparsity` (" << sparsity << ")" << endl;
+    return -1.0;
+  }
+
+  this->write_lock();
+  this->alloc_changes();
+
+  /* magnitude up to which the weights of each layer are removed */
+  vector<T> cut(L_, (T)std::max(threshold, 0.0));
+  uint64_t total = 0;
+  for(int l = 1; l < L_; l++) {
+    size_t size = (size_t)layers_[l] * layers_[l-1];
+    total += size;
+    size_t drop = (size_t)(std::max(sparsity, 0.0) * size);
+    if(sparsity < 0.0 || drop == 0) {
+      continue;
+    }
+
+    vector<T> w(layers_[l-1]);
+    vector<T> m;
+    m.reserve(size);
+    for(int i = 0; i < layers_[l]; i++) {
+      this->expand_row(l, i, &w[0], NULL);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        m.push_back(std::fabs(w[j]));
+      }
+    }
+    std::nth_element(m.begin(), m.begin() + (drop - 1), m.end());
+    cut[l] = m[drop - 1];
+  }
+
+  size_t kept = 0;
+  for(int l = 1; l < L_; l++) {
+    vector<T> w(layers_[l-1]);
+    for(int i = 0; i < layers_[l]; i++) {
+      this->expand_row(l, i, &w[0], NULL);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        kept += std::fabs(w[j]) > cut[l] ? 1 : 0;
+      }
+    }
+  }
+  /* the rows pointers are 32 bits */
+  if(kept > 0xffffffffULL) {
+    cout << "Too many weights kept (" << kept << ")" << endl;
+    this->write_unlock();
+    return -1.0;
+  }
+
+  vector<uint32_t> ptr(r_size_);
+  vector<uint32_t> idx;
+  idx.reserve(kept);
+  for(int l = 1; l < L_; l++) {
+    vector<T> w(layers_[l-1]);
+    for(int i = 0; i < layers_[l]; i++) {
+      ptr[r_off_[l] + i] = (uint32_t)idx.size();
+      this->expand_row(l, i, &w[0], NULL);
+      for(int j = 0; j < layers_[l-1]; j++) {
+        if(std::fabs(w[j]) > cut[l]) {
+          idx.push_back((uint32_t)j);
+        }
+      }
+    }
+    ptr[r_off_[l] + layers_[l]] = (uint32_t)idx.size();
+  }
+  this->compress(ptr, idx);
+
+  this->write_unlock();
+
+  return total == 0 ? 0.0 : 1.0 - (double)kept / total;
+}
+
+//
+// ### compress
+// Stores the layers as compressed rows holding the weights (and changes) of
+// the columns given, the others being removed. The changes must be allocated.
+// ```
+// @ptr {vector<uint32_t>} the `r_size_` rows pointers in `idx`
+// @idx {vector<uint32_t>} the columns kept by row, in increasing order
+// ```
+//
+template <typename T>
+void Net<T>::compress(const vector<uint32_t>& ptr,
+                      const vector<uint32_t>& idx)
+{
+  size_t kept = idx.size();
+  T* W = (T*)NN::alloc(kept * sizeof(T));
+  T* dW = (T*)NN::alloc(kept * sizeof(T));
+  uint32_t* c_ptr = (uint32_t*)NN::alloc(r_size_ * sizeof(uint32_t));
+  uint32_t* c_idx = (uint32_t*)NN::alloc(kept * sizeof(uint32_t));
+
+  memcpy(c_ptr, &ptr[0], r_size_ * sizeof(uint32_t));
+  if(kept > 0) {
+    memcpy(c_idx, &idx[0], kept * sizeof(uint32_t));
+  }
+
+  for(int l = 1; l < L_; l++) {
+    vector<T> w(layers_[l-1]);
+    vector<T> dw(layers_[l-1]);
+    for(int i = 0; i < layers_[l]; i++) {
+      this->expand_row(l, i, &w[0], &dw[0]);
+      for(uint32_t k = ptr[r_off_[l] + i]; k < ptr[r_off_[l] + i + 1]; k++) {
+        W[k] = w[idx[k]];
+        dW[k] = dw[idx[k]];
+      }
+    }
+  }
+
+  if(blob_.data != NULL) {
+    T* B = (T*)NN::alloc(n_size_ * sizeof(T));
+    memcpy(B, B_, n_size_ * sizeof(T));
+    B_ = B;
+    NN::blob_release(&blob_);
+  }
+  else {
+    NN::release(W_);
+    NN::release(c_ptr_);
+    NN::release(c_idx_);
+  }
+  NN::release(dW_);
+
+  W_ = W;
+  dW_ = dW;
+  c_ptr_ = c_ptr;
+  c_idx_ = c_idx;
+  c_size_ = kept;
+  w_size_ = kept;
+  pruned_ = true;
+  fixed_ = NULL;
+  this->flops_pruned();
+  this->cache_.invalidate();
+}
+
+//
+// ### expand_row
+// ```
+// @l  {int} the layer
+// @i  {int} the row
+// @w  {T*} filled with the `layers_[l-1]` weights of the row
+// @dw {T*} filled with their changes, if not NULL
+// ```
+//
+template <typename T>
+void Net<T>::expand_row(int l, int i, T* w, T* dw) const
+{
+  if(!pruned_) {
+    size_t row = w_off_[l] + (size_t)i * stride_[l];
+    memcpy(w, W_ + row, layers_[l-1] * sizeof(T));
+    if(dw != NULL) {
+      memcpy(dw, dW_ + row, layers_[l-1] * sizeof(T));
+    }
+    return;
+  }
+
+  const uint32_t* ptr = c_ptr_ + r_off_[l];
+  memset(w, 0, layers_[l-1] * sizeof(T));
+  if(dw != NULL) {
+    memset(dw, 0, layers_[l-1] * sizeof(T));
+  }
+  for(uint32_t k = ptr[i]; k < ptr[i+1]; k++) {
+    w[c_idx_[k]] = W_[k];
+    if(dw != NULL) {
+      dw[c_idx_[k]] = dW_[k];
+    }
+  }
+}
+
+//
+// ### flops_pruned
+// Counts the operations of `alloc_layers` on the weights kept only
+//
+template <typename T>
+void Net<T>::flops_pruned()
+{
+  flops_run_ = 0;
+  flops_train_ = 0;
+  for(int l = 1; l < L_; l++) {
+    const uint32_t* ptr = c_ptr_ + r_off_[l];
+    uint64_t w = ptr[layers_[l]] - ptr[0];
+    flops_run_ += 2 * w;
+    flops_train_ += 2 * w + (l > 1 ? 2 * w : 0) + 5 * w;
+  }
+}
+
+//
+// ### check_pruned
+// ```
+// @return {bool} whether the rows pointers and columns (read from a file) are
+//                consistent
+// ```
+//
+template <typename T>
+bool Net<T>::check_pruned() const
+{
+  size_t end = 0;
+  for(int l = 1; l < L_; l++) {
+    const uint32_t* ptr = c_ptr_ + r_off_[l];
+    if(ptr[0] != end) {
+      return false;
+    }
+    for(int i = 0; i < layers_[l]; i++) {
+      if(ptr[i+1] < ptr[i] || ptr[i+1] > c_size_) {
+        return false;
+      }
+      for(uint32_t k = ptr[i]; k < ptr[i+1]; k++) {
+        if(c_idx_[k] >= (uint32_t)layers_[l-1] ||
+           (k > ptr[i] && c_idx_[k] <= c_idx_[k-1])) {
+          return false;
+        }
+      }
+    }
+    end = ptr[layers_[l]];
+  }
+  return end == c_size_;
+}
+
+//
+// ### same_mask
+// ```
+// @nn {Net} a Net of the same layers
+//
+// @return {bool} whether both Nets keep the same weights
+// ```
+//
+template <typename T>
+bool Net<T>::same_mask(Net const& nn) const
+{
+  if(pruned_ != nn.pruned_ || w_size_ != nn.w_size_) {
+    return false;
+  }
+  return !pruned_ ||
+    (memcmp(c_ptr_, nn.c_ptr_, r_size_ * sizeof(uint32_t)) == 0 &&
+     memcmp(c_idx_, nn.c_idx_, c_size_ * sizeof(uint32_t)) == 0);
+}
+
+
+/******************************************************************************/
+/*                                 OPERATORS                                  */
+/******************************************************************************/
+
+//
+// ### reduce
+// Sets a slice of the weights to the mean of the weights of the given Nets,
+// which must share the same layers. Slices are cut on NN_ALIGN boundaries so
+// that the threads reducing contiguous slices never share a cache line.
+// ```
+// @nns   {Net**} the Nets to average
+// @n     {int} the number of Nets
+// @part  {int} the slice to reduce
+// @parts {int} the number of slices
+// ```
+//
+template <typename T>
+void Net<T>::reduce(Net* const* nns, int n, int part, int parts)
+{
+  const size_t line = NN_ALIGN / sizeof(T);
+  const size_t tile = NN_BLOCK / sizeof(T);
+
+  for(int a = 0; a < 2; a++) {
+    size_t size = a == 0 ? w_size_ : n_size_;
+    size_t lines = (size + line - 1) / line;
+    size_t from = std::min(size, lines * part / parts * line);
+    size_t to = std::min(size, lines * (part + 1) / parts * line);
+    T* dst = a == 0 ? W_ : B_;
+
+    /* one pass over the slice, a tile at a time kept in cache */
+    for(size_t k = from; k < to; k += tile) {
+      int len = (int)std::min(tile, to - k);
+      const T* src = a == 0 ? nns[0]->W_ : nns[0]->B_;
+      memcpy(dst + k, src + k, len * sizeof(T));
+      for(int i = 1; i < n; i++) {
+        src = a == 0 ? nns[i]->W_ : nns[i]->B_;
+        SIMD_NN::axpy((T)1, src + k, dst + k, len);
+      }
+      for(int j = 0; j < len; j++) {
+        dst[k + j] /= n;
+      }
+    }
+  }
+}
+
+//
+// ### operator+=
+//
+template <typename T>
+Net<T>& Net<T>::operator+=(Net const& nn) {
+  if(L_ != nn.L_) {
+    cout << "Can't add different layers " << L_ << " & " << nn.L_ << endl;
+    return *this;
+  }
+  for(int l = 0; l < L_; l++) {
+    if(layers_[l] != nn.layers_[l]) {
+      cout << "Can't add different layers" << endl;
+      return *this;
+    }
+  }
+  if(!this->same_mask(nn)) {
+    cout << "Can't add differently pruned networks" << endl;
+    return *this;
+  }
+
+  /* Add Weights (padding is zero on both sides) */
+  for(size_t k = 0; k < n_size_; k++) {
+    B_[k] += nn.B_[k];
+  }
+  for(size_t k = 0; k < w_size_; k++) {
+    W_[k] += nn.W_[k];
+  }
+
+  return *this;
+}
+
+//
+// ### operator-=
+//
+template <typename T>
+Net<T>& Net<T>::operator-=(Net const& nn) {
+  if(L_ != nn.L_) {
+    cout << "Can't substract different layers " << L_ << " & " << nn.L_ << endl;
+    return *this;
+  }
+  for(int l = 0; l < L_; l++) {
+    if(layers_[l] != nn.layers_[l]) {
+      cout << "Can't substract different layers" << endl;
+      return *this;
+    }
+  }
+  if(!this->same_mask(nn)) {
+    cout << "Can't substract differently pruned networks" << endl;
+    return *this;
+  }
+
+  /* Substract Weights */
+  for(size_t k = 0; k < n_size_; k++) {
+    B_[k] -= nn.B_[k];
+  }
+  for(size_t k = 0; k < w_size_; k++) {
+    W_[k] -= nn.W_[k];
+  }
+
+  return *this;
+}
+
+//
+// ### operator/=
+//
+template <typename T>
+Net<T>& Net<T>::operator/=(int const& N) {
+  /* Divide Weights */
+  for(size_t k = 0; k < n_size_; k++) {
+    B_[k] /= N;
+  }
+  for(size_t k = 0; k < w_size_; k++) {
+    W_[k] /= N;
+  }
+
+  return *this;
+}
+
+
+/******************************************************************************/
+/*                           MULTITHREAD TRAINING                             */
+/******************************************************************************/
+
+//
+// ### split_data
+// Assigns to each thread the next `step_size` points of its shard. Each thread
+// keeps the same contiguous shard of the training set for the whole training
+// and only receives a range of indices in it: no point is copied.
+// ```
+// @pool      {Pool} the pool of threads
+// @step      {int} the step number
+// @step_size {int} the step size
+//
+// @return    {int} the total number of points assigned
+// ```
+//
+template <typename T>
+int MT_NN::split_data(Pool<T>* pool, int step, int step_size)
+{
+  int size = (int)pool->train_set->size();
+  int total = 0;
+
+  for(int i = 0; i < pool->threads; i++) {
+    LearnWorker<T>* worker = &pool->workers[i];
+    int begin = (int)((long long)size * i / pool->threads);
+    int end = (int)((long long)size * (i + 1) / pool->threads);
+
+    if(step == 0) {
+      worker->to = begin;
+    }
+    worker->from = worker->to;
+    worker->to = std::min(worker->from + std::max(step_size, 1), end);
+
+    /* the next range is read while this one is learnt (mapped sets) */
+    pool->train_set->prefetch(worker->to,
+                              std::min(worker->to + std::max(step_size, 1),
+                                       end));
+
+    total += worker->to - worker->from;
+  }
+
+  return total;
+}
+
+//
+// ### pool_init
+// Creates the learning threads and their replicas of `nn`
+// ```
+// @pool    {Pool} the pool to initialize
+// @nn      {Net} the master Net
+// @threads {int} the number of threads
+// ```
+//
+template <typename T>
+void MT_NN::pool_init(Pool<T>* pool, Net<T>* nn, int threads)
+{
+  pool->master = nn;
+  pool->threads = threads;
+  pool->train_set = NULL;
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->stop = false;
+  pool->merge = false;
+  pool->n_active = 0;
+
+  uv_mutex_init(&pool->mutex);
+  uv_cond_init(&pool->start);
+  uv_cond_init(&pool->done);
+
+  pool->nns = new Net<T>*[threads];
+  pool->active = new Net<T>*[threads];
+  pool->workers = new LearnWorker<T>[threads];
+  pool->ids = new uv_thread_t[threads];
+
+  for(int i = 0; i < threads; i++) {
+    pool->nns[i] = new Net<T>(*nn);
+    pool->workers[i].nn = pool->nns[i];
+    pool->workers[i].pool = pool;
+    pool->workers[i].id = i;
+    pool->workers[i].from = 0;
+    pool->workers[i].to = 0;
+    pool->workers[i].error = 0.0;
+    pool->workers[i].busy = 0;
+
+    uv_thread_create(&pool->ids[i], MT_NN::learn<T>, &pool->workers[i]);
+  }
+}
+
+//
+// ### pool_run
+// Wakes up the threads with a non empty range to resynchronize their replica
+// with the master Net and learn their range, and waits until they are done.
+// ```
+// @pool {Pool} the pool
+//
+// @return {int} the number of threads that ran
+// ```
+//
+template <typename T>
+int MT_NN::pool_run(Pool<T>* pool)
+{
+  int active = 0;
+  for(int i = 0; i < pool->threads; i++) {
+    if(pool->workers[i].from < pool->workers[i].to) {
+      active++;
+    }
+  }
+
+  uv_mutex_lock(&pool->mutex);
+  pool->pending = active;
+  pool->generation++;
+  uv_cond_broadcast(&pool->start);
+
+  while(pool->pending > 0) {
+    uv_cond_wait(&pool->done, &pool->mutex);
+  }
+  uv_mutex_unlock(&pool->mutex);
+
+  return active;
+}
+
+//
+// ### pool_merge
+// Sets the weights of the master Net to the mean of the replicas that ran
+// during the last `pool_run`. Every thread reduces its own slice of the
+// weights across all the replicas at once.
+// ```
+// @pool {Pool} the pool
+// ```
+//
+template <typename T>
+void MT_NN::pool_merge(Pool<T>* pool)
+{
+  pool->n_active = 0;
+  for(int i = 0; i < pool->threads; i++) {
+    if(pool->workers[i].from < pool->workers[i].to) {
+      pool->active[pool->n_active++] = pool->nns[i];
+    }
+  }
+  if(pool->n_active == 0) {
+    return;
+  }
+
+  uv_mutex_lock(&pool->mutex);
+  pool->merge = true;
+  pool->pending = pool->threads;
+  pool->generation++;
+  uv_cond_broadcast(&pool->start);
+
+  while(pool->pending > 0) {
+    uv_cond_wait(&pool->done, &pool->mutex);
+  }
+  pool->merge = false;
+  uv_mutex_unlock(&pool->mutex);
+}
+
+//
+// ### pool_destroy
+// Stops and joins the threads and frees the replicas
+// ```
+// @pool {Pool} the pool to destroy
+// ```
+//
+template <typename T>
+void MT_NN::pool_destroy(Pool<T>* pool)
+{
+  uv_mutex_lock(&pool->mutex);
+  pool->stop = true;
+  uv_cond_broadcast(&pool->start);
+  uv_mutex_unlock(&pool->mutex);
+
+  for(int i = 0; i < pool->threads; i++) {
+    uv_thread_join(&pool->ids[i]);
+    delete pool->nns[i];
+  }
+  delete[] pool->nns;
+  delete[] pool->active;
+  delete[] pool->workers;
+  delete[] pool->ids;
+
+  uv_cond_destroy(&pool->start);
+  uv_cond_destroy(&pool->done);
+  uv_mutex_destroy(&pool->mutex);
+}
+
+//
+// ### hogwild
+// Hogwild thread loop: learns its shard on the shared weights until the
+// target error or the max number of iterations is reached
+// ```
+// @arg {HogwildWorker} the worker
+// ```
+//
+template <typename T>
+void MT_NN::hogwild(void *arg) {
+  HogwildWorker<T> *worker = (HogwildWorker<T>*)arg;
+  Hogwild<T> *hw = worker->hw;
+  bool stop = false;
+
+  for(int it = 0; it < hw->iterations && !stop; it++) {
+    double err = hw->nn->learn_shared(worker->from, worker->to, worker->buf);
+
+    uv_mutex_lock(&hw->mutex);
+    worker->error = err;
+    worker->epochs++;
+    stop = hw->stop;
+    uv_cond_signal(&hw->progress);
+    uv_mutex_unlock(&hw->mutex);
+  }
+
+  uv_mutex_lock(&hw->mutex);
+  hw->done++;
+  uv_cond_signal(&hw->progress);
+  uv_mutex_unlock(&hw->mutex);
+}
+
+//
+// ### learn
+// Learning thread loop: waits for a new step, resynchronizes its replica with
+// the master Net and learns its range of the master training set, or reduces
+// its slice of the replicas weights into the master Net
+// ```
+// @arg {LearnWorker} the worker owning the replica to train
+// ```
+//
+template <typename T>
+void MT_NN::learn(void *arg) {
+  LearnWorker<T> *worker = (LearnWorker<T>*)arg;
+  Pool<T> *pool = worker->pool;
+  int generation = 0;
+
+  for(;;) {
+    uv_mutex_lock(&pool->mutex);
+    while(pool->generation == generation && !pool->stop) {
+      uv_cond_wait(&pool->start, &pool->mutex);
+    }
+    if(pool->stop) {
+      uv_mutex_unlock(&pool->mutex);
+      return;
+    }
+    generation = pool->generation;
+    bool merge = pool->merge;
+    uv_mutex_unlock(&pool->mutex);
+
+    if(merge) {
+      pool->master->reduce(pool->active, pool->n_active,
+                           worker->id, pool->threads);
+    }
+    else if(worker->from >= worker->to) {
+      continue;
+    }
+    else {
+      Net<T> *nn = worker->nn;
+      uint64_t start = uv_hrtime();
+      nn->sync(*pool->master);
+      worker->error = nn->learn_range(*pool->train_set,
+                                      worker->from, worker->to);
+      worker->busy = uv_hrtime() - start;
+    }
+
+    uv_mutex_lock(&pool->mutex);
+    if(--pool->pending == 0) {
+      uv_cond_signal(&pool->done);
+    }
+    uv_mutex_unlock(&pool->mutex);
+  }
+}
+
+
+/******************************************************************************/
+/*                              INSTANTIATIONS                                */
+/******************************************************************************/
+
+template class TrainSet<float>;
+template class TrainSet<double>;
+template class Net<float>;
+template class Net<double>;
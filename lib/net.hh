@@ -0,0 +1,734 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef NN_NET_HH
+#define NN_NET_HH
+
+#include "nn.hh"
+#include "fixed.hh"
+
+#include <stdint.h>
+
+/* Size (in bytes) of the weights tiles kept hot by the batch kernels */
+#define NN_BLOCK (32 * 1024)
+/* Number of points converted at once by the bulk `train_set_add` */
+#define NN_BULK_CONVERT 4096
+/* Number of inputs run together by `run_batch` */
+#define NN_RUN_BATCH 64
+/* Number of inference scratch buffers kept for reuse */
+#define NN_SCRATCH_POOL 8
+/* Maximum size (in bytes) of a training set chunk */
+#define TRAIN_SET_CHUNK (8 * 1024 * 1024)
+/* Size (in bytes) of the first training set chunk */
+#define TRAIN_SET_FIRST_CHUNK (4 * 1024)
+/* Binary network files */
+#define NET_MAGIC "NNET"
+#define NET_VERSION 3
+/* Binary network files flags */
+#define NET_PRUNED 1
+
+//
+// ## NetHeader struct
+// Header of the binary network files. It is followed by the `L` layers sizes,
+// the `L` layers activations (since version 2) then, at offset `data`, by the
+// `B_` and `W_` blocks exactly as they are laid out in memory, so that they
+// can be used in place once the file is mapped. The `W_` block of a pruned
+// network (version 3) is followed by its rows pointers and columns.
+// Everything is stored in the host byte order.
+//
+struct NetHeader {
+  char     magic[4];             /* NET_MAGIC */
+  uint32_t version;              /* NET_VERSION */
+  uint32_t scalar;               /* sizeof(T) */
+  uint32_t align;                /* NN_ALIGN */
+  uint32_t L;                    /* layers count */
+  uint32_t flags;                /* NET_PRUNED (since version 3) */
+  double   alpha;                /* learning rate */
+  double   beta;                 /* momentum */
+  double   bias;                 /* bias value */
+  uint64_t n_size;               /* neurons block size */
+  uint64_t w_size;               /* weights block size */
+  uint64_t data;                 /* offset of the `B_` block */
+};
+
+//
+// ## SparseInput struct
+// The non-zero values of an input vector, sorted by index. `prev` lists the
+// columns of the first layer changes left non-zero by the previous sparse
+// point learnt, whose momentum is applied (and cleared) by the next update
+// (all the columns if `n_prev` is -1).
+//
+template <typename T>
+struct SparseInput {
+  const uint32_t* idx;           /* indices of the non-zero inputs */
+  const T* val;                  /* their values */
+  int nnz;
+  const uint32_t* prev;          /* non-zero inputs of the previous point */
+  int n_prev;
+};
+
+//
+// ## TrainSet Class
+// Training points packed in large slabs. Inputs and results are stored in
+// separate chunks with a fixed stride equal to their dimension. The first chunk
+// holds `2^base_` points and the chunk `k` the points [2^(base_+k-1),
+// 2^(base_+k)), up to chunks of `2^shift_` points: small sets stay small and
+// large ones use chunks of about TRAIN_SET_CHUNK bytes. Chunks are never moved
+// once allocated so growing the set never copies the points already added.
+// A set can also be mapped from a file of packed records (the input vector
+// followed by the result vector): the chunks then point in the mapping and the
+// inputs and results share the record stride.
+// The inputs of a set whose first point is sparse are stored sparse instead,
+// as index / value pairs (compressed rows), and only the results are chunked.
+//
+template <typename T>
+class TrainSet {
+public:
+  TrainSet();
+  ~TrainSet();
+
+  //
+  // ### init
+  // ```
+  // @in_dim  {int} input vectors size
+  // @out_dim {int} result vectors size
+  // ```
+  //
+  void init(int, int);
+
+  //
+  // ### append
+  // ```
+  // @in  {const T*} `n` packed input vectors
+  // @out {const T*} `n` packed result vectors
+  // @n   {size_t} number of points
+  // ```
+  //
+  void append(const T*, const T*, size_t);
+
+  //
+  // ### append_sparse
+  // Appends a point given by its non-zero inputs. Once a set stores sparse
+  // inputs, dense points are stored sparse too; sparse points appended to a
+  // set of dense points are expanded.
+  // ```
+  // @idx {const uint32_t*} sorted indices of the non-zero inputs
+  // @val {const T*} their values
+  // @nnz {int} number of non-zero inputs
+  // @out {const T*} result vector
+  // ```
+  //
+  void append_sparse(const uint32_t*, const T*, int, const T*);
+
+  //
+  // ### map
+  // ```
+  // @path {std::string} a file of packed `in_dim + out_dim` records
+  //
+  // @return {bool} false if the file could not be mapped
+  // ```
+  //
+  bool map(const std::string&);
+
+  //
+  // ### prefetch
+  // Hints that the points [from, to) will be read soon
+  // ```
+  // @from {size_t} first point
+  // @to   {size_t} end of the range
+  // ```
+  //
+  void prefetch(size_t, size_t);
+
+  //
+  // ### clear
+  //
+  void clear();
+
+  //
+  // ### accessors
+  //
+  size_t size() const { return size_; }
+  const T* in(size_t i) const {
+    size_t c = this->chunk(i);
+    return in_chunks_[c] + (i - this->first(c)) * in_stride_;
+  }
+  const T* out(size_t i) const {
+    size_t c = this->chunk(i);
+    return out_chunks_[c] + (i - this->first(c)) * out_stride_;
+  }
+
+  //
+  // ### sparse accessors
+  // Inputs of the point `i` of a sparse set
+  //
+  bool sparse() const { return sparse_; }
+  size_t nnz() const { return sp_idx_.size(); }
+  int nnz(size_t i) const { return (int)(sp_ptr_[i + 1] - sp_ptr_[i]); }
+  const uint32_t* idx(size_t i) const {
+    return sp_idx_.empty() ? NULL : &sp_idx_[0] + sp_ptr_[i];
+  }
+  const T* val(size_t i) const {
+    return sp_val_.empty() ? NULL : &sp_val_[0] + sp_ptr_[i];
+  }
+
+private:
+  TrainSet(TrainSet const&);
+  TrainSet& operator=(TrainSet const&);
+
+  void layout();
+
+  //
+  // ### chunk / first
+  // The chunk holding the point `i` and the first point of the chunk `c`
+  //
+  size_t chunk(size_t i) const {
+    if((i >> shift_) != 0) {
+      return (shift_ - base_) + (i >> shift_);
+    }
+    if((i >> base_) == 0) {
+      return 0;
+    }
+    return TrainSet::log2(i) - base_ + 1;
+  }
+  size_t first(size_t c) const {
+    if(c == 0) {
+      return 0;
+    }
+    if(c <= (size_t)(shift_ - base_)) {
+      return (size_t)1 << (base_ + c - 1);
+    }
+    return (c - (shift_ - base_)) << shift_;
+  }
+  static int log2(size_t i) {
+#if defined(__GNUC__)
+    return (int)(sizeof(unsigned long long) * 8 - 1) -
+      __builtin_clzll((unsigned long long)i);
+#else
+    int l = 0;
+    while(i >>= 1) {
+      l++;
+    }
+    return l;
+#endif
+  }
+
+  vector<T*>                         in_chunks_;  /* input chunks */
+  vector<T*>                         out_chunks_; /* result chunks */
+  size_t                             size_;       /* number of points */
+  int                                in_dim_;     /* input vectors size */
+  int                                out_dim_;    /* result vectors size */
+  int                                in_stride_;  /* input vectors stride */
+  int                                out_stride_; /* result vectors stride */
+  int                                shift_;      /* log2(points by chunk) */
+  int                                base_;       /* log2(first chunk) */
+  NN::Blob                           blob_;       /* mapped file, if any */
+
+  bool                               sparse_;     /* sparse inputs */
+  vector<size_t>                     sp_ptr_;     /* point `i` first value */
+  vector<uint32_t>                   sp_idx_;     /* non-zero inputs indices */
+  vector<T>                          sp_val_;     /* non-zero inputs values */
+};
+
+//
+// ## Net Class
+// The network itself, generic over the scalar type `T` used for the weights,
+// the values and the training set (`float` or `double`).
+//
+template <typename T>
+class Net : public NN {
+public:
+  Net(vector<int> &, T, T, T, const vector<int>& = vector<int>());
+  Net(std::string &);
+  Net(Net const&);
+  ~Net();
+
+  //
+  // ### load
+  // ```
+  // @blob {NN::Blob} a binary network file, owned by the Net on success
+  //
+  // @return {Net*} the network, NULL if the file is not a valid network
+  // ```
+  //
+  static Net* load(NN::Blob&);
+
+  /**************************************************************************/
+  /*                               METHODS                                  */
+  /**************************************************************************/
+
+  //
+  // ### precision
+  //
+  const char* precision();
+
+  //
+  // ### run
+  // ```
+  // @in {vector<double>} input vector
+  // ```
+  //
+  vector<double> run(vector<double> &);
+
+  //
+  // ### run_sparse
+  // ```
+  // @idx {vector<uint32_t>} indices of the non-zero inputs
+  // @val {vector<double>} their values
+  // ```
+  //
+  vector<double> run_sparse(vector<uint32_t> &, vector<double> &);
+
+  //
+  // ### run_batch
+  // ```
+  // @in  {const double*|const float*} `n` packed input vectors
+  // @out {double*|float*} `n` packed output vectors
+  // @n   {int} number of inputs
+  // ```
+  //
+  void run_batch(const double*, double*, int) const;
+  void run_batch(const float*, float*, int) const;
+
+  //
+  // ### input_size / output_size
+  //
+  int input_size() { return layers_[0]; }
+  int output_size() { return layers_[L_-1]; }
+
+  //
+  // ### train_set_add
+  // ```
+  // @in         {vector<double>} input vector
+  // @out        {vector<double>} result vector to learn on
+  // ```
+  //
+  void train_set_add(vector<double> &,
+                     vector<double> &);
+
+  //
+  // ### train_set_add_sparse
+  // ```
+  // @idx {vector<uint32_t>} indices of the non-zero inputs
+  // @val {vector<double>} their values
+  // @out {vector<double>} result vector to learn on
+  // ```
+  //
+  void train_set_add_sparse(vector<uint32_t> &,
+                            vector<double> &,
+                            vector<double> &);
+
+  //
+  // ### train_set_add
+  // Bulk append
+  // ```
+  // @in  {const double*|const float*} `n` packed input vectors
+  // @out {const double*|const float*} `n` packed result vectors
+  // @n   {size_t} number of points
+  // ```
+  //
+  void train_set_add(const double*,
+                     const double*,
+                     size_t);
+  void train_set_add(const float*,
+                     const float*,
+                     size_t);
+
+  //
+  // ### train_set_clear
+  //
+  void train_set_clear();
+
+  //
+  // ### train_set_size
+  //
+  size_t train_set_size() { return train_set_.size(); }
+
+  //
+  // ### train_set_mmap
+  // ```
+  // @path {std::string} a file of packed training records
+  // ```
+  //
+  bool train_set_mmap(const std::string&);
+
+  //
+  // ### train
+  // Monothreaded train
+  // ```
+  // @error      {double} target error
+  // @iterations {int} max number of iterations
+  // @batch_size {int} number of samples by weights update
+  // ```
+  //
+  void train(double, int, int);
+
+  //
+  // ### mt_train
+  // Multithreaded train
+  // ```
+  // @error      {double} target error
+  // @iterations {int} max number of iterations
+  // @step_size  {int} size of training set by step
+  // @n_threads  {int} the number of threads to use
+  // @batch_size {int} number of samples by weights update
+  // @tune       {bool} automatic step size and number of threads
+  // ```
+  //
+  void mt_train(double, int, int, int, int, bool);
+
+  //
+  // ### hogwild_train
+  // Lock-free multithreaded train
+  // ```
+  // @error      {double} target error
+  // @iterations {int} max number of iterations
+  // @n_threads  {int} the number of threads to use
+  // ```
+  //
+  void hogwild_train(double, int, int);
+
+  //
+  // ### learn
+  // ```
+  // @in {vector<T>} input vector
+  // @out {vector<T>} result vector
+  // ```
+  //
+  vector<T> learn(vector<T> &,
+                  vector<T> &);
+
+  //
+  // ### learn_batch
+  // ```
+  // @in  {const T**} `n` input vectors
+  // @out {const T**} `n` result vectors
+  // @n   {int} number of samples
+  //
+  // @return {double} the sum of the samples mean square errors
+  // ```
+  //
+  double learn_batch(const T**, const T**, int);
+
+  //
+  // ### learn_step
+  //
+  double learn_step();
+
+  //
+  // ### learn_range
+  // ```
+  // @set  {TrainSet} the training set
+  // @from {int} first point
+  // @to   {int} end of the range
+  // ```
+  //
+  double learn_range(TrainSet<T> &, int, int);
+
+  //
+  // ### learn_shared
+  // ```
+  // @from {int} first point
+  // @to   {int} end of the range
+  // @buf  {T*} the thread's activations
+  // ```
+  //
+  double learn_shared(int, int, T*);
+
+  //
+  // ### sync
+  // ```
+  // @nn {Net} the Net to copy the weights from
+  // ```
+  //
+  void sync(Net const&);
+
+  //
+  // ### to_string
+  //
+  std::string to_string();
+
+  //
+  // ### get_state
+  //
+  std::string get_state(bool);
+
+  //
+  // ### save
+  //
+  bool save(const std::string&);
+
+  //
+  // ### prune
+  // ```
+  // @threshold {double} magnitude up to which the weights are removed
+  // @sparsity  {double} fraction of the weights of each layer to remove
+  //                     instead, if not negative
+  //
+  // @return {double} the fraction of the weights removed, -1 on error
+  // ```
+  //
+  double prune(double, double);
+
+  //
+  // ### Operators
+  //
+  Net& operator+=(Net const&);
+  Net& operator-=(Net const&);
+  Net& operator/=(int const&);
+
+  //
+  // ### reduce
+  // ```
+  // @nns   {Net**} the Nets to average
+  // @n     {int} the number of Nets
+  // @part  {int} the slice to reduce
+  // @parts {int} the number of slices
+  // ```
+  //
+  void reduce(Net* const*, int, int, int);
+
+private:
+  //
+  // ### mt_tune
+  // ```
+  // @max_threads {int} the maximum number of threads
+  // @step_size   {int*} the chosen step size
+  // @threads     {int*} the chosen number of threads
+  // ```
+  //
+  void mt_tune(int, int*, int*);
+
+  //
+  // ### Propagation
+  //
+  void forward(T*, T*) const;
+  void forward_from(int, T*, T*) const;
+  void forward_sparse(const SparseInput<T>&, T*, T*) const;
+  void forward_batch(T*, int) const;
+  template <typename S> void run_packed(const S*, S*, int) const;
+
+  //
+  // ### Scratch
+  // Activation buffers of NN_RUN_BATCH samples for the re-entrant inference
+  //
+  T* scratch_acquire() const;
+  void scratch_release(T*) const;
+
+  //
+  // ### Weights lock
+  // Readers / writer lock giving the priority to the writer, so that a steady
+  // flow of inference never starves the training
+  //
+  void read_lock() const;
+  void read_unlock() const;
+  void write_lock() const;
+  void write_unlock() const;
+  template <typename S> void append_packed(const S*, const S*, size_t);
+  void backward(const T*, const T*, T*, const SparseInput<T>* = NULL);
+
+  //
+  // ### Sparse inputs
+  //
+  double learn_sparse(TrainSet<T>&, int, int, T*, T*, T*);
+  bool sparse_check(vector<uint32_t>&, vector<double>&);
+  uint64_t flops_learn() const;
+
+  //
+  // ### Pruning
+  //
+  void expand_row(int, int, T*, T*) const;
+  void compress(const vector<uint32_t>&, const vector<uint32_t>&);
+  bool read_mask(istream&, vector<uint32_t>*, vector<uint32_t>*);
+  void flops_pruned();
+  bool check_pruned() const;
+  bool same_mask(Net const&) const;
+
+  //
+  // ### Layout
+  //
+  void alloc_layers();
+  void free_layers();
+  void alloc_changes();
+  void alloc_batch(int);
+  Net();
+  Net& operator=(Net const&);
+
+  /**************************************************************************/
+  /*                              MEMBERS                                   */
+  /**************************************************************************/
+
+  /* Each layer `l` is stored as one row-major block of `layers_[l]` rows of */
+  /* `stride_[l]` values starting at `w_off_[l]` in `W_` and `dW_`. Neuron   */
+  /* values of layer `l` start at `n_off_[l]` in `B_`, `D_`, `sum_`, `val_`. */
+  /* Every block and row is NN_ALIGN aligned and zero padded.                */
+  T*                                 W_;         /* weights */
+  T*                                 dW_;        /* changes (lazy if mapped) */
+  T*                                 B_;         /* bias weights */
+
+  T*                                 D_;         /* deltas */
+  T*                                 sum_;       /* incoming sums */
+  T*                                 val_;       /* values */
+
+  vector<int>                        stride_;    /* weights row stride */
+  vector<size_t>                     w_off_;     /* weights layer offsets */
+  vector<size_t>                     n_off_;     /* neurons layer offsets */
+  size_t                             w_size_;    /* weights block size */
+  size_t                             n_size_;    /* neurons block size */
+  NN::Blob                           blob_;      /* file holding `W_`, `B_` */
+
+  /* Once pruned, `W_` and `dW_` only hold the `w_size_` weights kept, as    */
+  /* compressed rows: row `i` of layer `l` is [c_ptr_[r_off_[l] + i],        */
+  /* c_ptr_[r_off_[l] + i + 1]) in `W_`, `c_idx_` holding the columns.      */
+  bool                               pruned_;    /* compressed layers */
+  vector<size_t>                     r_off_;     /* rows pointers offsets */
+  size_t                             r_size_;    /* rows pointers count */
+  size_t                             c_size_;    /* weights kept */
+  uint32_t*                          c_ptr_;     /* rows first weight */
+  uint32_t*                          c_idx_;     /* weights columns */
+
+  vector<int>                        layers_;    /* layers structure */
+  vector<int>                        act_;       /* layers activations */
+  typename FIXED_NN::Kernel<T>::forward_t fixed_; /* compiled forward pass */
+  int                                L_;         /* layers count */
+  uint64_t                           flops_run_; /* operations by input */
+  uint64_t                           flops_train_; /* by point learnt */
+
+  T                                  alpha_;     /* learning rate */
+  T                                  beta_;      /* momentum */
+  T                                  bias_;      /* bias value */
+
+  /* Mini-batch buffers: sample `b` neurons start at `b * n_size_` in `bval_` */
+  /* and `bD_`, with the same layers offsets as `val_` and `D_`.             */
+  int                                batch_size_; /* samples by update */
+  int                                batch_cap_; /* batch buffers capacity */
+  T*                                 bval_;      /* batch values */
+  T*                                 bD_;        /* batch deltas */
+  T*                                 bG_;        /* batch gradients tile */
+
+  TrainSet<T>                        train_set_; /* training set */
+
+  /* The input layer values of `val_` are all zero but `state_idx_` when the */
+  /* last `run` was sparse, so that the next one only clears those.         */
+  vector<uint32_t>                   state_idx_; /* last sparse run inputs */
+  bool                               state_sparse_;
+
+  /* `lock_` is taken for writing whenever the weights are updated and for   */
+  /* reading by the re-entrant inference, which keeps its activations in    */
+  /* scratch buffers taken from a small pool.                                */
+  mutable uv_rwlock_t                lock_;      /* weights lock */
+  mutable uv_mutex_t                 gate_;      /* writer priority gate */
+  mutable uv_mutex_t                 scratch_mutex_; /* scratch pool lock */
+  mutable vector<T*>                 scratch_;   /* free scratch buffers */
+};
+
+
+/******************************************************************************/
+/*                           MULTITHREADING HELPERS                           */
+/******************************************************************************/
+
+namespace MT_NN {
+  template <typename T> struct Pool;
+
+  //
+  // ## LearnWorker struct
+  //
+  template <typename T>
+  struct LearnWorker {
+    Net<T>* nn;
+    double error;
+
+    Pool<T>* pool;
+    int id;              /* slice reduced by the thread */
+    int from;            /* current range in the thread's shard */
+    int to;
+    uint64_t busy;       /* time spent learning the last range (ns) */
+  };
+
+  //
+  // ## Pool struct
+  // Learning threads kept alive for a whole `mt_train`, each one owning a
+  // preallocated replica of the master Net
+  //
+  template <typename T>
+  struct Pool {
+    Net<T>* master;
+    Net<T>** nns;
+    Net<T>** active;                       /* replicas to merge */
+    int n_active;
+    LearnWorker<T>* workers;
+    uv_thread_t* ids;
+    int threads;
+
+    TrainSet<T>* train_set;                /* master training set */
+
+    uv_mutex_t mutex;
+    uv_cond_t start;
+    uv_cond_t done;
+    int generation;
+    int pending;
+    bool merge;                            /* reduce rather than learn */
+    bool stop;
+  };
+
+  //
+  // ## Hogwild struct
+  // State shared by the threads of a `hogwild_train`
+  //
+  template <typename T>
+  struct Hogwild {
+    Net<T>* nn;
+    int iterations;
+
+    uv_mutex_t mutex;
+    uv_cond_t progress;                    /* an iteration of a thread ended */
+    int done;                              /* number of threads done */
+    bool stop;
+  };
+
+  //
+  // ## HogwildWorker struct
+  //
+  template <typename T>
+  struct HogwildWorker {
+    Hogwild<T>* hw;
+    int from;            /* the thread's shard */
+    int to;
+    T* buf;              /* activations */
+
+    double error;        /* error of the last iteration */
+    int epochs;          /* number of iterations done */
+  };
+
+  //
+  // ### Functions
+  //
+  template <typename T> void pool_init(Pool<T>*, Net<T>*, int);
+  template <typename T> int pool_run(Pool<T>*);
+  template <typename T> void pool_merge(Pool<T>*);
+  template <typename T> void pool_destroy(Pool<T>*);
+
+  template <typename T> int split_data(Pool<T>*, int, int);
+  template <typename T> void learn(void *arg);
+  template <typename T> void hogwild(void *arg);
+};
+
+#endif
@@ -20,12 +20,29 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "nn.hh"
+#include "net.hh"
+#include "activation.hh"
+
+#ifndef NN_STANDALONE
+#include <node_buffer.h>
+#endif
 
 #include <sstream>
 #include <algorithm>
+#include <cstdio>
+#include <climits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
+#ifndef NN_STANDALONE
 using namespace v8;
 using namespace node;
+#endif
 using namespace std;
 
 
@@ -35,161 +52,182 @@ using namespace std;
 
 //
 // ### NN
+//
+NN::NN()
+{
+  log_ = false;
+  run_pending_ = NULL;
+  run_busy_ = false;
+  training_ = NULL;
+  cancel_ = 0;
+  stats_on_ = false;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+//
+// ### ~NN
+//
+NN::~NN()
+{
+}
+
+//
+// ### alloc
+// Allocates a NN_ALIGN aligned block
 // ```
-// @layers {vector<int>} the layers structure
-// @alpha  {double} the learning rate
-// @beta   {double} the momentum
+// @size {size_t} size in bytes
+// @zero {bool} whether to zero the block
 // ```
 //
-NN::NN(vector<int> &layers,
-       double alpha = 0.3,
-       double beta = 0.1,
-       double bias = -1.0)
+void* NN::alloc(size_t size, bool zero)
 {
-  log_ = false;
-  layers_ = layers;
-  alpha_ = alpha;
-  beta_ = beta;
-  bias_ = bias;
-  op_count_ = 0;
-  L_ = layers.size();
-
-  /* Layers initialization */
-  W_.resize(L_); dW_.resize(L_); B_.resize(L_);
-  D_.resize(L_); sum_.resize(L_); val_.resize(L_);
-
-  for(int l = 0; l < L_; l++) {
-    W_[l].resize(layers_[l]);
-    dW_[l].resize(layers_[l]);
-    B_[l].resize(layers_[l]);
-
-    D_[l].resize(layers_[l]);
-    sum_[l].resize(layers_[l]);
-    val_[l].resize(layers_[l]);
-
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        W_[l][i].resize(layers_[l-1]);
-        dW_[l][i].resize(layers_[l-1]);
-        B_[l][i] = NN::fRand(0.2, 0.4);
-
-        sum_[l][i] = 0;
-        val_[l][i] = 0;
-
-        for(int j = 0; j < layers_[l-1]; j++) {
-          W_[l][i][j] = NN::fRand(0.2, 0.4);
-          dW_[l][i][j] = 0;
-        }
-      }
-    }
+  void* p = NULL;
+  size = std::max(size, (size_t)1);
+#ifdef _WIN32
+  p = _aligned_malloc(size, NN_ALIGN);
+#else
+  if(posix_memalign(&p, NN_ALIGN, size) != 0) {
+    p = NULL;
   }
+#endif
+  assert(p != NULL);
+  if(zero) {
+    memset(p, 0, size);
+  }
+  return p;
 }
 
 //
-// ### NN
+// ### release
 // ```
-// @str {std::string} the string representation of the network
+// @p {void*} a block returned by `alloc`
 // ```
 //
-NN::NN(std::string& str)
+void NN::release(void* p)
 {
-  log_ = false;
-  istringstream iss(str);
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
 
-  iss >> L_;
-  layers_.resize(L_);
+//
+// ### blob_load
+// Maps the file privately: its pages are shared with the page cache (and any
+// other process mapping it) until they are written. Read only mappings are
+// expected to be read sequentially and are never charged as private memory,
+// so they can be larger than the physical memory. Falls back to reading the
+// file when mapping is not available.
+// ```
+// @path     {std::string} the file path
+// @map      {bool} whether to mmap the file rather than reading it
+// @blob     {Blob} the blob to fill
+// @writable {bool} whether the mapping may be written (copy on write)
+// ```
+//
+bool NN::blob_load(const std::string& path, bool map, Blob* blob,
+                   bool writable)
+{
+#ifndef _WIN32
+  if(map) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* p = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+      return false;
+    }
+    if(!writable) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+    }
 
-  for(int i = 0; i < (int)layers_.size(); i ++) {
-    iss >> layers_[i];
+    blob->data = (char*)p;
+    blob->size = st.st_size;
+    blob->mapped = true;
+    return true;
   }
+#endif
 
-  iss >> alpha_;
-  iss >> beta_;
-  iss >> bias_;
-  op_count_ = 0;
-
-  /* Layers initialization */
-  W_.resize(L_); dW_.resize(L_); B_.resize(L_);
-  D_.resize(L_); sum_.resize(L_); val_.resize(L_);
-
-  for(int l = 0; l < L_; l++) {
-    W_[l].resize(layers_[l]);
-    dW_[l].resize(layers_[l]);
-    B_[l].resize(layers_[l]);
-
-    D_[l].resize(layers_[l]);
-    sum_[l].resize(layers_[l]);
-    val_[l].resize(layers_[l]);
-
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        W_[l][i].resize(layers_[l-1]);
-        dW_[l][i].resize(layers_[l-1]);
-        iss >> B_[l][i];
-
-        sum_[l][i] = 0;
-        val_[l][i] = 0;
+  FILE* f = fopen(path.c_str(), "rb");
+  if(f == NULL) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if(size <= 0) {
+    fclose(f);
+    return false;
+  }
 
-        for(int j = 0; j < layers_[l-1]; j++) {
-          iss >> W_[l][i][j];
-          dW_[l][i][j] = 0;
-        }
-      }
-    }
+  char* data = (char*)NN::alloc(size);
+  bool ok = fread(data, 1, size, f) == (size_t)size;
+  fclose(f);
+  if(!ok) {
+    NN::release(data);
+    return false;
   }
+
+  blob->data = data;
+  blob->size = size;
+  blob->mapped = false;
+  return true;
 }
 
 //
-// ### NN Copy constructor
+// ### blob_release
 // ```
-// @nn <NN> the NN to copy
+// @blob {Blob} a blob filled by `blob_load`
 // ```
 //
-NN::NN(NN const& nn)
+void NN::blob_release(Blob* blob)
 {
-  layers_ = vector<int>(nn.layers_);
-  alpha_ = double(nn.alpha_);
-  beta_ = double(nn.beta_);
-  bias_ = double(nn.bias_);
-  op_count_ = long(nn.op_count_);
-  L_ = int(layers_.size());
-
-  W_.resize(L_); dW_.resize(L_); B_.resize(L_);
-  D_.resize(L_); sum_.resize(L_); val_.resize(L_);
-
-  for(int l = 0; l < L_; l++) {
-    W_[l].resize(layers_[l]);
-    dW_[l].resize(layers_[l]);
-    B_[l].resize(layers_[l]);
-
-    D_[l].resize(layers_[l]);
-    sum_[l].resize(layers_[l]);
-    val_[l].resize(layers_[l]);
-
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        W_[l][i].resize(layers_[l-1]);
-        dW_[l][i].resize(layers_[l-1]);
-
-        /* Initialize values */
-        B_[l][i] = nn.B_[l][i];
-        D_[l][i] = nn.D_[l][i];
-        sum_[l][i] = nn.sum_[l][i];
-        val_[l][i] = nn.val_[l][i];
-
-        for(int j = 0; j < layers_[l-1]; j++) {
-          W_[l][i][j] = nn.W_[l][i][j];
-          dW_[l][i][j] = nn.dW_[l][i][j];
-        }
-      }
-    }
+  if(blob->data == NULL) {
+    return;
+  }
+#ifndef _WIN32
+  if(blob->mapped) {
+    munmap(blob->data, blob->size);
   }
+  else
+#endif
+  {
+    NN::release(blob->data);
+  }
+  *blob = Blob();
 }
 
 //
-// ### ~NN
+// ### blob_prefetch
+// ```
+// @blob   {Blob} the blob
+// @offset {size_t} start of the range in bytes
+// @size   {size_t} size of the range in bytes
+// ```
 //
-NN::~NN() {};
+void NN::blob_prefetch(Blob* blob, size_t offset, size_t size)
+{
+#ifndef _WIN32
+  if(!blob->mapped || offset >= blob->size) {
+    return;
+  }
+  size = std::min(size, blob->size - offset);
+
+  /* madvise needs a page aligned address */
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start = offset / page * page;
+  madvise(blob->data + start, size + offset - start, MADV_WILLNEED);
+#endif
+}
 
 //
 // ### fRand
@@ -204,706 +242,1153 @@ double NN::fRand(double fMin, double fMax)
   return fMin + f * (fMax - fMin);
 };
 
+//
+// ### set_log
+//
+void NN::set_log(bool status)
+{
+  log_ = status;
+}
 
 //
-// ### run
+// ### set_training
 // ```
-// @in {vector<double>} input vector
+// @worker {TrainWorker} the asynchronous training running, NULL once done
 // ```
 //
-vector<double> NN::run(vector<double> &in)
+void NN::set_training(MT_NN::TrainWorker* worker)
 {
-  /* initialization */
-  if(in.size() != (unsigned)layers_[0]) {
-    cout << "Incompatible Dimensions `in` (" << in.size() << ")" << endl;
-  }
-  for(unsigned int i = 0; i < val_[0].size(); i++) {
-    val_[0][i] = in[i];
+  if(worker != NULL) {
+    __sync_lock_test_and_set(&cancel_, 0);
   }
+  training_ = worker;
+}
 
-  /* propagation */
-  for(int l = 1; l < L_; l++) {
-    for(int i = 0; i < layers_[l]; i++) {
-      sum_[l][i] = bias_ * B_[l][i];
-      for(int j = 0; j < layers_[l-1]; j++) {
-        sum_[l][i] += W_[l][i][j] * val_[l-1][j];
-      }
-      val_[l][i] = 1 / (1 + exp(-sum_[l][i]));
-    }
+//
+// ### progress
+// The report is stored in the worker and the loop is woken up: reports sent
+// faster than the loop delivers them are coalesced, the last one wins
+// ```
+// @it      {int} the iteration
+// @error   {double} the error of the iteration
+// @samples {double} the number of points learnt since the training started
+// ```
+//
+void NN::progress(int it, double error, double samples)
+{
+#ifndef NN_STANDALONE
+  MT_NN::TrainWorker* worker = training_;
+  if(worker == NULL || worker->progress_cb.IsEmpty()) {
+    return;
   }
 
-  return val_[L_-1];
+  uv_mutex_lock(&worker->mutex);
+  worker->reported = true;
+  worker->iteration = it;
+  worker->error = error;
+  worker->samples = samples;
+  worker->elapsed = (uv_hrtime() - worker->start) / 1e9;
+  uv_mutex_unlock(&worker->mutex);
+
+  uv_async_send(&worker->async);
+#else
+  /* no event loop to report to */
+  (void)it;
+  (void)error;
+  (void)samples;
+#endif
 }
 
+//
+// ### cancel
+//
+void NN::cancel()
+{
+  __sync_lock_test_and_set(&cancel_, 1);
+}
 
 //
-// ### learn
+// ### cancelled
+//
+bool NN::cancelled()
+{
+  return __sync_fetch_and_add(&cancel_, 0) != 0;
+}
+
+//
+// ### set_stats
 // ```
-// @in {vector<double>} input vector
-// @out {vector<double>} result vector
+// @enabled {bool}
 // ```
 //
-vector<double> NN::learn(vector<double> &in,
-                         vector<double> &out)
+void NN::set_stats(bool enabled)
 {
-  if(out.size() != (unsigned)layers_[L_-1]) {
-    cout << "Incompatible Dimensions `out` (" << out.size() << ")" << endl;
+#ifndef NN_STATS
+  enabled = false;
+#endif
+  if(enabled && !stats_on_) {
+    memset(&stats_, 0, sizeof(stats_));
   }
+  stats_on_ = enabled;
+}
 
-  this->run(in);
+//
+// ### get_stats
+// ```
+// @stats {Stats} filled with a snapshot of the counters
+// ```
+//
+bool NN::get_stats(Stats* stats) const
+{
+  uint64_t* dst = (uint64_t*)stats;
+  uint64_t* src = (uint64_t*)&stats_;
+  for(size_t i = 0; i < sizeof(Stats) / sizeof(uint64_t); i++) {
+    dst[i] = __sync_fetch_and_add(&src[i], 0);
+  }
+  return stats_on_;
+}
 
-  /* back propagation */
-  for(int l = L_-1; l >= 0; l--) {
-    for(int j = 0; j < layers_[l]; j++) {
-      /* output layer */
-      if(l == L_-1) {
-        D_[l][j] = out[j] - val_[l][j];
-      }
-      /* inner layer */
-      else {
-        D_[l][j] = 0;
-        for(int i = 0; i < layers_[l+1]; i++) {
-          if(l > 0) {
-            D_[l][j] += W_[l+1][i][j] * D_[l+1][i];
-          }
-          /* weight update */
-          double dW = alpha_ * val_[l][j] * D_[l+1][i];
-
-          W_[l+1][i][j] += dW + beta_ * dW_[l+1][i][j];
-          dW_[l+1][i][j] = dW;
-
-          /* bias weight update */
-          B_[l+1][i] = alpha_ * bias_ * D_[l+1][i];
-
-          op_count_++;
-        }
-      }
-      if(l > 0) {
-        D_[l][j] *= val_[l][j] * (1 - val_[l][j]);
-      }
-    }
+//
+// ### stats_run
+// ```
+// @samples {uint64_t} inputs run
+// @flops   {uint64_t} floating point operations by input
+// @since   {uint64_t} the `stats_clock` at the start of the call
+// ```
+//
+void NN::stats_run(uint64_t samples, uint64_t flops, uint64_t since) const
+{
+#ifdef NN_STATS
+  if(since == 0) {
+    return;
   }
+  uint64_t ns = uv_hrtime() - since;
+  int bucket = 0;
+  while(bucket < NN_LATENCY_BUCKETS - 1 && (ns >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+  __sync_fetch_and_add(&stats_.run_samples, samples);
+  __sync_fetch_and_add(&stats_.flops, samples * flops);
+  __sync_fetch_and_add(&stats_.latency[bucket], (uint64_t)1);
+#endif
+}
+
+//
+// ### set_cache
+// ```
+// @capacity {int} max number of cached inputs, 0 to disable the cache
+// ```
+//
+void NN::set_cache(int capacity)
+{
+  cache_.resize(capacity, this->input_size(), this->output_size());
+}
 
-  return val_[L_-1];
+//
+// ### get_cache
+// ```
+// @counters {Cache::Counters} filled with a snapshot of the counters
+// ```
+//
+void NN::get_cache(Cache::Counters* counters)
+{
+  cache_.get_counters(counters);
 }
 
 //
-// ### learn_step
-// Learn the current training set and return mean square error
+// ### run_cached
+// ```
+// @in  {const double*} `n` packed input vectors
+// @out {double*} `n` packed output vectors
+// @n   {int} number of inputs
+// ```
 //
-double NN::learn_step() {
-  double err = 0.0;
+void NN::run_cached(const double* in, double* out, int n)
+{
+  if(!cache_.enabled()) {
+    this->run_batch(in, out, n);
+    return;
+  }
+
+  int in_dim = this->input_size();
+  int out_dim = this->output_size();
+  uint64_t generation = cache_.generation();
 
-  for(unsigned int i = 0; i < train_in_.size(); i++) {
-    vector<double> res = this->learn(train_in_[i], train_out_[i]);
-    /* error calculation */
-    double e = 0;
-    for(unsigned int j = 0; j < res.size(); j++) {
-      e += pow(res[j] - train_out_[i][j], 2);
+  vector<int> misses;
+  for(int k = 0; k < n; k++) {
+    if(!cache_.lookup(in + (size_t)k * in_dim, out + (size_t)k * out_dim)) {
+      misses.push_back(k);
     }
-    err += e / res.size();
+  }
+  if(misses.empty()) {
+    return;
   }
 
-  return err;
-}
+  int m = (int)misses.size();
+  vector<double> min((size_t)m * in_dim);
+  vector<double> mout((size_t)m * out_dim);
+  for(int i = 0; i < m; i++) {
+    memcpy(&min[(size_t)i * in_dim], in + (size_t)misses[i] * in_dim,
+           in_dim * sizeof(double));
+  }
 
+  this->run_batch(&min[0], &mout[0], m);
 
+  for(int i = 0; i < m; i++) {
+    memcpy(out + (size_t)misses[i] * out_dim, &mout[(size_t)i * out_dim],
+           out_dim * sizeof(double));
+    cache_.insert(&min[(size_t)i * in_dim], &mout[(size_t)i * out_dim],
+                  generation);
+  }
+}
+
+#ifndef NN_STANDALONE
 //
-// ### train_set_add
-// ```
-// @in         {vector<double>} input vector
-// @out        {vector<double>} result vector to learn on
-// ```
+// ### run_dispatch
+// Requests arriving while a batch runs are coalesced in the next one, which is
+// queued as soon as the running one is done
 //
-void NN::train_set_add(vector<double> &in,
-                       vector<double> &out)
+void NN::run_dispatch(bool done)
 {
-  /* initialization */
-  if(in.size() != (unsigned)layers_[0]) {
-    cout << "Incompatible Dimensions `in` (" << in.size() << ")" << endl;
+  if(!done && run_busy_) {
+    return;
   }
-  if(out.size() != (unsigned)layers_[L_-1]) {
-    cout << "Incompatible Dimensions `out` (" << out.size() << ")" << endl;
+  run_busy_ = false;
+
+  if(run_pending_ != NULL) {
+    MT_NN::RunWorker* worker = run_pending_;
+    run_pending_ = NULL;
+    run_busy_ = true;
+
+    /* keep the object alive until the batch is done */
+    this->Ref();
+    uv_queue_work(uv_default_loop(), &worker->request,
+                  MT_NN::run_start, MT_NN::run_done);
   }
 
-  train_in_.push_back(in);
-  train_out_.push_back(out);
+  if(done) {
+    this->Unref();
+  }
 }
 
 //
-// ### train_set_clear
+// ### hogwild_running
 //
-void NN::train_set_clear()
+bool NN::hogwild_running()
 {
-  train_in_.clear();
-  train_out_.clear();
+  return training_ != NULL && training_->hogwild;
 }
 
+
+/******************************************************************************/
+/*                             NN BINDING                                     */
+/******************************************************************************/
+
+Persistent<Function> NN::constructor;
+
 //
-// ### train
+// ### ToString wrapper
+//
+Handle<Value> NN::ToString(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  /* return values */
+  v8::Handle<v8::String> result = v8::String::New(nn->to_string().c_str());
+
+  return scope.Close(result);
+}
+
+//
+// ### Precision wrapper
+//
+Handle<Value> NN::Precision(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  return scope.Close(v8::String::New(nn->precision()));
+}
+
+//
+// ### Save wrapper
+//
+Handle<Value> NN::Save(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  if(!args[0]->IsString()) {
+    ThrowException(
+      Exception::TypeError(String::New("Path expected as argument 0")));
+    return scope.Close(Undefined());
+  }
+  std::string path = std::string(
+      *v8::String::Utf8Value(args[0]->ToString()));
+
+  if(!nn->save(path)) {
+    std::string msg = "Unable to save network to `" + path + "`";
+    ThrowException(Exception::Error(String::New(msg.c_str())));
+    return scope.Close(Undefined());
+  }
+
+  return scope.Close(Undefined());
+}
+
+//
+// ### Prune
 // ```
-// @error      {double} target error
-// @iterations {int} max number of iterations
+// @threshold {Number} magnitude up to which the weights are removed
+// @sparsity  {Number} fraction of the weights of each layer to remove instead
+//                     (optional)
 // ```
 //
-void NN::train(double error = 0.01,
-               int iterations = 20000)
-{
-  if(train_out_.size() != train_in_.size()) {
-    cout << "Incompatible Dimensions `train_out_` ("
-         << train_out_.size() << ")"
-         << " `train_in_` (" << train_in_.size() << ")" << endl;
-  }
-
-  if(log_) {
-    cout << "----------------------------------" << endl;
-    cout << "  LAYERS: [";
-    for(unsigned int i = 0; i < layers_.size(); i++) {
-      if(i > 0) cout << ", ";
-      cout << layers_[i];
-    }
-    cout << "]" << endl;
-    cout << "  ALPHA: " << alpha_ << endl;
-    cout << "  BETA: " << beta_ << endl;
-    cout << "  BIAS: " << bias_ << endl;
-    cout << "  TRAINING SIZE: " << train_in_.size() << endl;
-    cout << "  ERROR THRESHOLD: " << error << endl;
-    cout << "  MAX ITERATIONS: " << iterations << endl;
-    cout << "----------------------------------" << endl;
-  }
-  int it = 0;
-  double err = 0;
-
-  do {
-    err = 0;
-    for(unsigned int i = 0; i < train_in_.size(); i++) {
-      vector<double> res = this->learn(train_in_[i], train_out_[i]);
-      /* error calculation */
-      double e = 0;
-      for(unsigned int j = 0; j < res.size(); j++) {
-        e += pow(res[j] - train_out_[i][j], 2);
-      }
-      err += e / res.size();
-    }
-    err /= train_in_.size();
-    it++;
-    if(log_) {
-      cout << "[" << it << "] " << err << endl;
+Handle<Value> NN::Prune(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  if(!args[0]->IsNumber() || args[0]->ToNumber()->Value() < 0) {
+    ThrowException(
+      Exception::TypeError(String::New("Threshold expected as argument 0")));
+    return scope.Close(Undefined());
+  }
+  double threshold = args[0]->ToNumber()->Value();
+
+  double sparsity = -1.0;
+  if(args.Length() > 1 && !args[1]->IsUndefined()) {
+    if(!args[1]->IsNumber() || args[1]->ToNumber()->Value() < 0 ||
+       args[1]->ToNumber()->Value() >= 1) {
+      ThrowException(
+        Exception::TypeError(String::New("Sparsity expected as argument 1")));
+      return scope.Close(Undefined());
     }
-  } while(err > error && it < iterations);
+    sparsity = args[1]->ToNumber()->Value();
+  }
+
+  /* the layers are replaced */
+  if(nn->training_ != NULL) {
+    ThrowException(
+      Exception::Error(String::New("Unable to prune a training network")));
+    return scope.Close(Undefined());
+  }
+
+  double removed = nn->prune(threshold, sparsity);
+  if(removed < 0) {
+    ThrowException(
+      Exception::Error(String::New("Unable to prune the network")));
+    return scope.Close(Undefined());
+  }
+
+  return scope.Close(Number::New(removed));
 }
 
 //
-// ### mt_train
+// ### Load
+// Module function: returns a new NN object loaded from a file
 // ```
-// @error      {double} target error
-// @iterations {int} max number of iterations
-// @step_size  {int} size of training set by step
-// @n_threads  {int} the number of threads to use
+// @path {String} the file path
+// @map  {Boolean} whether to mmap the weights (optional)
 // ```
 //
-void NN::mt_train(double error = 0.01,
-                  int iterations = 20000,
-                  int step_size = 100,
-                  int thread = 4)
-{
-  if(train_out_.size() != train_in_.size()) {
-    cout << "Incompatible Dimensions `train_out_` ("
-         << train_out_.size() << ")"
-         << " `train_in_` (" << train_in_.size() << ")" << endl;
+Handle<Value> NN::Load(const Arguments& args) {
+  HandleScope scope;
+
+  if(!args[0]->IsString()) {
+    ThrowException(
+      Exception::TypeError(String::New("Path expected as argument 0")));
+    return scope.Close(Undefined());
+  }
+  std::string path = std::string(
+      *v8::String::Utf8Value(args[0]->ToString()));
+
+  bool map = false;
+  if(args[1]->IsBoolean()) {
+    map = args[1]->ToBoolean()->Value();
+  }
+
+  NN* nn = NN::load(path, map);
+  if(nn == NULL) {
+    std::string msg = "Unable to load network from `" + path + "`";
+    ThrowException(Exception::Error(String::New(msg.c_str())));
+    return scope.Close(Undefined());
+  }
+
+  Handle<Value> argv[] = { External::New(nn) };
+  return scope.Close(constructor->NewInstance(1, argv));
+}
+
+//
+// ### GetState wrapper
+//
+Handle<Value> NN::GetState(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  bool compact = false;
+  if(args[0]->IsBoolean()) {
+    compact = args[0]->ToBoolean()->Value();
   }
 
-  int it = 0;
-  double err = 0.0;
+  /* return values */
+  v8::Handle<v8::String> result = v8::String::New(nn->get_state(compact).c_str());
 
-  int step = 0;
-  int total = 0;
+  return scope.Close(result);
+}
 
-  if(log_) {
-    cout << "----------------------------------" << endl;
-    cout << "  STARTING MULTITHREAD TRAINING" << endl << endl;
+//
+// ### SparseArg
+// Reads a sparse input vector `{ indices: [...], values: [...] }`
+// ```
+// @arg {Value} the argument
+// @idx {vector<uint32_t>} filled with the indices of the non-zero inputs
+// @val {vector<double>} filled with their values
+//
+// @return {bool} false if the argument is not a sparse vector
+// ```
+//
+bool NN::SparseArg(Handle<Value> arg,
+                   vector<uint32_t>* idx,
+                   vector<double>* val)
+{
+  if(!arg->IsObject() || arg->IsArray()) {
+    return false;
   }
-  if(train_in_.size() < 1) {
-    cout << "Training set is empty..." << endl;
+  Local<Value> i = arg->ToObject()->Get(String::NewSymbol("indices"));
+  Local<Value> v = arg->ToObject()->Get(String::NewSymbol("values"));
+  if(!i->IsArray() || !v->IsArray()) {
+    return false;
   }
-  else {
-    if(log_) {
-      cout << "  STEP SIZE: " << step_size << endl;
-      cout << "  NUMBER OF THREADS: " << thread << endl << endl;
-      cout << "  ERROR THRESHOLD: " << error << endl;
-      cout << "  MAX ITERATIONS: " << iterations << endl << endl;
-      cout << "  ALPHA: " << alpha_ << endl;
-      cout << "  BETA: " << beta_ << endl;
-      cout << "  BIAS: " << bias_ << endl;
-      cout << "  TRAINING SIZE: " << train_in_.size() << endl;
-      cout << "----------------------------------" << endl;
-    }
 
-    /* Main iteration loop */
-    do {
-      step = 0;
-      total = 0;
-      err = 0.0;
-
-      /* Step loop */
-      while(total < (int)train_in_.size()) {
-        //cout << endl << "IT[" << it << "] Step " << step << endl;
-        //cout << "Initializing children NNs... ";
-        /* Copy and initialize children NN */
-        NN** nns = new NN*[thread];
-        for(int i = 0; i < thread; i++) {
-          nns[i] = new NN(*this);
-          nns[i]->train_set_clear();
-        }
-        //cout << "OK!" << endl <<
-        //  "Split data... ";
-        int added = MT_NN::split_data(nns, thread, step, step_size,
-                                      train_in_,
-                                      train_out_);
-        total += added;
-        //cout << "OK!" << endl;
-
-        int n_thread = thread;
-        /* If we splited less training points than number of NN, we only work */
-        /* with this number of NN during the current step                     */
-        if(added < n_thread) {
-          n_thread = added;
-        }
+  Local<Array> indices = Array::Cast(*i);
+  Local<Array> values = Array::Cast(*v);
+  idx->resize(indices->Length());
+  val->resize(values->Length());
 
-        /* Launch threads */
-        //cout << "Launch threads... ";
-        uv_thread_t* nns_ids = new uv_thread_t[n_thread];
-        MT_NN::LearnWorker** workers = new MT_NN::LearnWorker*[n_thread];
-        for(int i = 0; i < n_thread; i++) {
-          workers[i] = new MT_NN::LearnWorker();
-          workers[i]->nn = nns[i];
+  for(unsigned int k = 0; k < indices->Length(); k++) {
+    (*idx)[k] = indices->Get(Integer::New(k))->Uint32Value();
+  }
+  for(unsigned int k = 0; k < values->Length(); k++) {
+    (*val)[k] = values->Get(Integer::New(k))->ToNumber()->Value();
+  }
 
-          uv_thread_create(&nns_ids[i], MT_NN::learn, workers[i]);
-        }
-        //cout << "OK!" << endl;
+  return true;
+}
 
-        /* Wait until threads are done */
-        //cout << "Waiting they are done... ";
-        for(int i = 0; i < n_thread; i++) {
-          uv_thread_join(&nns_ids[i]);
-        }
-        //cout << "OK!" << endl;
+//
+// ### TrainSetAdd wrapper
+//
+Handle<Value> NN::TrainSetAdd(const Arguments& args) {
+  HandleScope scope;
 
-        /* Compute result */
-        //cout << "Compute results... ";
-        NN *nn_origin = new NN(*this);
-        for(int i = 0; i < n_thread; i++) {
-          *this += *nns[i];
-        }
-        *this -= *nn_origin;
-        *this /= n_thread;
-        //cout << "OK!" << endl;
-
-        /* look at error & it */
-        //cout << "Compute error... ";
-        int total_training_size = 0;
-        for(int i = 0; i < n_thread; i++) {
-          err += workers[i]->error;
-          total_training_size += workers[i]->nn->train_in_.size();
-        }
-        err /= total_training_size;
-        //cout << "OK!" << endl;
-
-        /* Free memory */
-        //cout << "Free memory... ";
-        delete nn_origin;
-        for(int i = 0; i < n_thread; i++) {
-          delete nns[i];
-          delete workers[i];
-        }
-        //cout << "OK!" << endl;
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-        step++;
-      }
-      if(log_) {
-        cout << "[" << it << "] " << err << endl;
-      }
-      it++;
-    } while(err > error && it < iterations);
+  vector<uint32_t> idx;
+  vector<double> val;
+  bool sparse = NN::SparseArg(args[0], &idx, &val);
+
+  if(!sparse && !args[0]->IsArray()) {
+    ThrowException(
+      Exception::TypeError(
+        String::New("Training `in` values expected as argument 0")));
+    return scope.Close(Undefined());
   }
+  if(!args[1]->IsArray()) {
+    ThrowException(
+      Exception::TypeError(
+        String::New("Training `out` values expected as argument 0")));
+    return scope.Close(Undefined());
+  }
+
+  /* training set extraction */
+  Local<Array> out = Array::Cast(*args[1]);
+  vector<double> output(out->Length());
+
+  for(unsigned int i = 0; i < out->Length(); i ++) {
+    output[i] = out->Get(Integer::New(i))->ToNumber()->Value();
+  }
+
+  if(sparse) {
+    nn->train_set_add_sparse(idx, val, output);
+    return scope.Close(Undefined());
+  }
+
+  Local<Array> in = Array::Cast(*args[0]);
+  vector<double> input(in->Length());
+
+  for(unsigned int i = 0; i < in->Length(); i ++) {
+    input[i] = in->Get(Integer::New(i))->ToNumber()->Value();
+  }
+
+  nn->train_set_add(input, output);
+
+  return scope.Close(Undefined());
 }
 
 //
-// ### to_string
+// ### TrainSetAddBulk wrapper
+// ```
+// @in    {Float64Array|Float32Array|Buffer} packed input vectors
+// @out   {Float64Array|Float32Array|Buffer} packed result vectors, of the same
+//        type as `in`. Buffers hold values in the precision of the network
+// @count {Number} number of points (optional, all the points of `in` by
+//        default)
+// ```
 //
-std::string NN::to_string()
-{
-  ostringstream oss;
+Handle<Value> NN::TrainSetAddBulk(const Arguments& args) {
+  HandleScope scope;
+
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  oss << (int)layers_.size();
+  const void* data[2] = { NULL, NULL };
+  size_t length[2] = { 0, 0 };
+  int type[2] = { 0, 0 };
 
-  for(int i = 0; i < (int)layers_.size(); i ++) {
-    oss << " " << layers_[i];
+  for(int a = 0; a < 2; a++) {
+    if(!args[a]->IsObject()) {
+      ThrowException(
+        Exception::TypeError(
+          String::New("Typed arrays or Buffers expected as arguments 0, 1")));
+      return scope.Close(Undefined());
+    }
+    Local<Object> obj = args[a]->ToObject();
+
+    if(Buffer::HasInstance(obj)) {
+      bool single = strcmp(nn->precision(), "float32") == 0;
+      size_t size = single ? sizeof(float) : sizeof(double);
+      data[a] = Buffer::Data(obj);
+      length[a] = Buffer::Length(obj) / size;
+      type[a] = single ? kExternalFloatArray : kExternalDoubleArray;
+    }
+    else if(obj->HasIndexedPropertiesInExternalArrayData()) {
+      data[a] = obj->GetIndexedPropertiesExternalArrayData();
+      length[a] = obj->GetIndexedPropertiesExternalArrayDataLength();
+      type[a] = obj->GetIndexedPropertiesExternalArrayDataType();
+    }
+
+    if(type[a] != kExternalDoubleArray && type[a] != kExternalFloatArray) {
+      ThrowException(
+        Exception::TypeError(
+          String::New("Float64Array, Float32Array or Buffer expected")));
+      return scope.Close(Undefined());
+    }
+  }
+  if(type[0] != type[1]) {
+    ThrowException(
+      Exception::TypeError(
+        String::New("Training `in` and `out` values of different types")));
+    return scope.Close(Undefined());
   }
 
-  oss << " " << alpha_;
-  oss << " " << beta_;
-  oss << " " << bias_;
+  size_t in_dim = nn->input_size();
+  size_t out_dim = nn->output_size();
 
-  for(int l = 0; l < L_; l++) {
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        oss << " " << B_[l][i];
-        for(int j = 0; j < layers_[l-1]; j++) {
-          oss << " " << W_[l][i][j];
-        }
-      }
+  size_t count = length[0] / in_dim;
+  if(args[2]->IsNumber()) {
+    /* checked as a double: NaN, infinite or huge counts are never cast */
+    double n = args[2]->ToNumber()->Value();
+    if(n != n || n > (double)(length[0] / in_dim)) {
+      ThrowException(
+        Exception::RangeError(String::New("Not enough training values")));
+      return scope.Close(Undefined());
     }
+    count = n > 0 ? (size_t)n : 0;
+  }
+  if(count > length[1] / out_dim) {
+    ThrowException(
+      Exception::RangeError(String::New("Not enough training values")));
+    return scope.Close(Undefined());
+  }
+  /* the training set is indexed with `int` */
+  if(count > (size_t)INT_MAX - nn->train_set_size()) {
+    ThrowException(
+      Exception::RangeError(String::New("Training set too large")));
+    return scope.Close(Undefined());
   }
 
-  return oss.str();
+  /* call */
+  if(type[0] == kExternalDoubleArray) {
+    nn->train_set_add((const double*)data[0], (const double*)data[1], count);
+  }
+  else {
+    nn->train_set_add((const float*)data[0], (const float*)data[1], count);
+  }
+
+  return scope.Close(Undefined());
 }
 
 //
-// ### get_state
+// ### TrainSetMmap wrapper
 //
-std::string NN::get_state(bool compact = false)
-{
-  ostringstream oss;
+Handle<Value> NN::TrainSetMmap(const Arguments& args) {
+  HandleScope scope;
 
-  oss << (int)layers_.size();
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  for(int i = 0; i < (int)layers_.size(); i++) {
-    oss << " " << layers_[i];
+  if(!args[0]->IsString()) {
+    ThrowException(
+      Exception::TypeError(String::New("Path expected as argument 0")));
+    return scope.Close(Undefined());
   }
+  std::string path = std::string(
+      *v8::String::Utf8Value(args[0]->ToString()));
 
-  if(compact)
-    oss << " " << "compact";
-  else
-    oss << " " << "full";
-
-  for(int l = 0; l < L_; l++) {
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        for(int j = 0; j < layers_[l-1]; j++) {
-          double s = W_[l][i][j] * val_[l-1][j];
-          if(!compact) {
-            oss << " " << s;
-          }
-          else if(s != 0.0) {
-            oss << " " << l
-                << " " << i
-                << " " << j
-                << " " << s;
-          }
-        }
-      }
-    }
+  if(!nn->train_set_mmap(path)) {
+    std::string msg = "Unable to map training set `" + path + "`";
+    ThrowException(Exception::Error(String::New(msg.c_str())));
+    return scope.Close(Undefined());
   }
 
-  return oss.str();
+  return scope.Close(Undefined());
 }
 
 //
-// ### set_log
+// ### Train wrapper
 //
-void NN::set_log(bool status)
-{
-  log_ = status;
-}
+Handle<Value> NN::Train(const Arguments& args) {
+  HandleScope scope;
 
-/******************************************************************************/
-/*                                 OPERATORS                                  */
-/******************************************************************************/
+  /* unwraping */
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  /* one training at a time: the running one owns the weights */
+  if(nn->training_ != NULL) {
+    ThrowException(
+      Exception::Error(String::New("Network is already training")));
+    return scope.Close(Undefined());
+  }
+
+  /* call */
+  if(args[0]->IsNumber() && args[1]->IsNumber() && args[2]->IsNumber()) {
+    nn->train(args[0]->ToNumber()->Value(),
+              (int)args[1]->ToNumber()->Value(),
+              (int)args[2]->ToNumber()->Value());
+  }
+  else if(args[0]->IsNumber() && args[1]->IsNumber()) {
+    nn->train(args[0]->ToNumber()->Value(),
+              (int)args[1]->ToNumber()->Value());
+  }
+  else if(args[0]->IsNumber()) {
+    nn->train(args[0]->ToNumber()->Value());
+  }
+  else {
+    nn->train();
+  }
+
+  return scope.Close(Undefined());
+}
 
 //
-// ### operator+=
+// ### Multithread Train Wrapper
 //
-NN& NN::operator+=(NN const& nn) {
-  if(L_ != nn.L_) {
-    cout << "Can't add different layers " << L_ << " & " << nn.L_ << endl;
-    return *this;
+Handle<Value> NN::MTTrain(const Arguments& args) {
+  HandleScope scope;
+
+  double target_error = 0;
+  int iterations = 0;
+  int step_size = 0;
+  int threads = 0;
+  int batch_size = 0;
+  bool tune = false;
+
+  Local<Function> cb;
+  Local<Value> progress;
+
+  if(args[0]->IsNumber() && args[1]->IsNumber() &&
+     args[2]->IsNumber() && args[3]->IsNumber() && args[4]->IsNumber()) {
+    target_error = args[0]->ToNumber()->Value();
+    iterations = (int)args[1]->ToNumber()->Value();
+    step_size = (int)args[2]->ToNumber()->Value();
+    threads = (int)args[3]->ToNumber()->Value();
+    batch_size = (int)args[4]->ToNumber()->Value();
+
+    cb = Local<Function>::Cast(args[5]);
+    progress = args[6];
+    tune = args[7]->BooleanValue();
   }
+  else if(args[0]->IsNumber() && args[1]->IsNumber() &&
+          args[2]->IsNumber() && args[3]->IsNumber()) {
+    target_error = args[0]->ToNumber()->Value();
+    iterations = (int)args[1]->ToNumber()->Value();
+    step_size = (int)args[2]->ToNumber()->Value();
+    threads = (int)args[3]->ToNumber()->Value();
 
-  /* Add Weights */
-  for(int l = 0; l < L_; l++) {
-    if(layers_[l] != nn.layers_[l]) {
-      cout << "Can't add different layers" << endl;
-      return *this;
-    }
+    cb = Local<Function>::Cast(args[4]);
+  }
+  else if(args[0]->IsNumber() && args[1]->IsNumber() && args[2]->IsNumber()) {
+    target_error = args[0]->ToNumber()->Value();
+    iterations = (int)args[1]->ToNumber()->Value();
+    step_size = (int)args[2]->ToNumber()->Value();
 
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        B_[l][i] += nn.B_[l][i];
+    cb = Local<Function>::Cast(args[3]);
+  }
+  else if(args[0]->IsNumber() && args[1]->IsNumber()) {
+    target_error = args[0]->ToNumber()->Value();
+    iterations = (int)args[1]->ToNumber()->Value();
 
-        for(int j = 0; j < layers_[l-1]; j++) {
-          W_[l][i][j] += nn.W_[l][i][j];
-        }
-      }
-    }
+    cb = Local<Function>::Cast(args[2]);
+  }
+  else if(args[0]->IsNumber()) {
+    target_error = args[0]->ToNumber()->Value();
+
+    cb = Local<Function>::Cast(args[1]);
+  }
+  else {
+    cb = Local<Function>::Cast(args[0]);
   }
 
-  return *this;
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  /* one training at a time: the running one owns the weights */
+  if(nn->training_ != NULL) {
+    ThrowException(
+      Exception::Error(String::New("Network is already training")));
+    return scope.Close(Undefined());
+  }
+
+  MT_NN::TrainWorker *worker = new MT_NN::TrainWorker();
+
+  worker->request.data = worker;
+  worker->cb = Persistent<Function>::New(cb);
+  worker->nn = nn;
+
+  worker->target_error = target_error;
+  worker->iterations = iterations;
+  worker->step_size = step_size;
+  worker->threads = threads;
+  worker->batch_size = batch_size;
+  worker->tune = tune;
+  worker->hogwild = false;
+
+  MT_NN::train_queue(worker, progress);
+
+  return scope.Close(Undefined());
 }
 
 //
-// ### operator-=
+// ### Hogwild Train Wrapper
 //
-NN& NN::operator-=(NN const& nn) {
-  if(L_ != nn.L_) {
-    cout << "Can't substract different layers " << L_ << " & " << nn.L_ << endl;
-    return *this;
+Handle<Value> NN::HogwildTrain(const Arguments& args) {
+  HandleScope scope;
+
+  if(!args[0]->IsNumber() || !args[1]->IsNumber() ||
+     !args[2]->IsNumber() || !args[3]->IsFunction()) {
+    ThrowException(Exception::TypeError(
+          String::New("Expected error, iterations, threads and callback")));
+    return scope.Close(Undefined());
   }
 
-  /* Add Weights */
-  for(int l = 0; l < L_; l++) {
-    if(layers_[l] != nn.layers_[l]) {
-      cout << "Can't substract different layers" << endl;
-      return *this;
-    }
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  /* one training at a time: the running one owns the weights */
+  if(nn->training_ != NULL) {
+    ThrowException(
+      Exception::Error(String::New("Network is already training")));
+    return scope.Close(Undefined());
+  }
+  /* nor can a `run_async` batch read them while the threads update them */
+  if(nn->run_busy_) {
+    ThrowException(
+      Exception::Error(String::New("Network is running")));
+    return scope.Close(Undefined());
+  }
 
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        B_[l][i] -= nn.B_[l][i];
+  MT_NN::TrainWorker *worker = new MT_NN::TrainWorker();
 
-        for(int j = 0; j < layers_[l-1]; j++) {
-          W_[l][i][j] -= nn.W_[l][i][j];
-        }
-      }
-    }
+  worker->request.data = worker;
+  worker->cb = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+  worker->nn = nn;
+
+  worker->target_error = args[0]->ToNumber()->Value();
+  worker->iterations = (int)args[1]->ToNumber()->Value();
+  worker->step_size = 0;
+  worker->threads = (int)args[2]->ToNumber()->Value();
+  worker->batch_size = 0;
+  worker->tune = false;
+  worker->hogwild = true;
+
+  MT_NN::train_queue(worker, args[4]);
+
+  return scope.Close(Undefined());
+}
+
+//
+// ### Cancel
+// Stops the asynchronous training running at the end of its current step
+//
+Handle<Value> NN::Cancel(const Arguments& args) {
+  HandleScope scope;
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  nn->cancel();
+
+  return scope.Close(Undefined());
+}
+
+//
+// ### SetStats
+//
+Handle<Value> NN::SetStats(const Arguments& args) {
+  HandleScope scope;
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  if(!args[0]->IsBoolean()) {
+    ThrowException(
+      Exception::TypeError(String::New("Boolean expected as argument 0")));
+    return scope.Close(Undefined());
   }
 
-  return *this;
+#ifndef NN_STATS
+  if(args[0]->ToBoolean()->Value()) {
+    ThrowException(
+      Exception::Error(String::New("Compiled without NN_STATS")));
+    return scope.Close(Undefined());
+  }
+#endif
+
+  nn->set_stats(args[0]->ToBoolean()->Value());
+
+  return scope.Close(Undefined());
 }
 
 //
-// ### operator/=
+// ### GetStats
 //
-NN& NN::operator/=(int const& N) {
-  /* Add Weights */
-  for(int l = 0; l < L_; l++) {
-    for(int i = 0; i < layers_[l]; i++) {
-      if(l > 0) {
-        B_[l][i] /= N;
+Handle<Value> NN::GetStats(const Arguments& args) {
+  HandleScope scope;
+  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
+
+  static const char* phases[NN::PHASE_COUNT] = {
+    "train", "clone", "split", "learn", "merge", "error"
+  };
+
+  NN::Stats s;
+  bool enabled = nn->get_stats(&s);
+
+  Local<Object> stats = Object::New();
+  stats->Set(String::NewSymbol("enabled"), Boolean::New(enabled));
+  stats->Set(String::NewSymbol("flops"), Number::New((double)s.flops));
+  stats->Set(String::NewSymbol("train_samples"),
+             Number::New((double)s.train_samples));
+  stats->Set(String::NewSymbol("run_samples"),
+             Number::New((double)s.run_samples));
+
+  /* wall time by phase in milliseconds */
+  Local<Object> time = Object::New();
+  for(int p = 0; p < NN::PHASE_COUNT; p++) {
+    time->Set(String::NewSymbol(phases[p]),
+              Number::New(s.phases[p] / 1e6));
+  }
+  stats->Set(String::NewSymbol("phases"), time);
 
-        for(int j = 0; j < layers_[l-1]; j++) {
-          W_[l][i][j] /= N;
-        }
-      }
-    }
+  /* `run_latency[k]` calls took between 2^k and 2^(k+1) ns */
+  Local<Array> latency = Array::New(NN_LATENCY_BUCKETS);
+  for(int k = 0; k < NN_LATENCY_BUCKETS; k++) {
+    latency->Set(k, Number::New((double)s.latency[k]));
   }
+  stats->Set(String::NewSymbol("run_latency"), latency);
 
-  return *this;
+  return scope.Close(stats);
 }
 
-/******************************************************************************/
-/*                             NN BINDING                                     */
-/******************************************************************************/
-
 //
-// ### ToString wrapper
+// ### SetCache
 //
-Handle<Value> NN::ToString(const Arguments& args) {
+Handle<Value> NN::SetCache(const Arguments& args) {
   HandleScope scope;
-
-  /* unwraping */
   NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  /* return values */
-  v8::Handle<v8::String> result = v8::String::New(nn->to_string().c_str());
+  if(!args[0]->IsNumber() || args[0]->ToNumber()->Value() < 0) {
+    ThrowException(
+      Exception::TypeError(String::New("Capacity expected as argument 0")));
+    return scope.Close(Undefined());
+  }
 
-  return scope.Close(result);
+  nn->set_cache((int)args[0]->ToNumber()->Value());
+
+  return scope.Close(Undefined());
 }
 
 //
-// ### GetState wrapper
+// ### GetCache
 //
-Handle<Value> NN::GetState(const Arguments& args) {
+Handle<Value> NN::GetCache(const Arguments& args) {
   HandleScope scope;
-
-  /* unwraping */
   NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  bool compact = false;
-  if(args[0]->IsBoolean()) {
-    compact = args[0]->ToBoolean()->Value();
-  }
+  Cache::Counters c;
+  nn->get_cache(&c);
 
-  /* return values */
-  v8::Handle<v8::String> result = v8::String::New(nn->get_state(compact).c_str());
+  Local<Object> cache = Object::New();
+  cache->Set(String::NewSymbol("capacity"), Integer::New(c.capacity));
+  cache->Set(String::NewSymbol("size"), Integer::New(c.size));
+  cache->Set(String::NewSymbol("hits"), Number::New((double)c.hits));
+  cache->Set(String::NewSymbol("misses"), Number::New((double)c.misses));
+  cache->Set(String::NewSymbol("evictions"),
+             Number::New((double)c.evictions));
+  cache->Set(String::NewSymbol("invalidations"),
+             Number::New((double)c.invalidations));
 
-  return scope.Close(result);
+  return scope.Close(cache);
 }
 
 //
-// ### TrainSetAdd wrapper
+// ### Run wrapper
 //
-Handle<Value> NN::TrainSetAdd(const Arguments& args) {
+Handle<Value> NN::Run(const Arguments& args) {
   HandleScope scope;
 
-  /* unwraping */
+  /* unwrapping */
   NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  if(!args[0]->IsArray()) {
+  /* `hogwild_train` updates the weights without any lock */
+  if(nn->hogwild_running()) {
     ThrowException(
-      Exception::TypeError(
-        String::New("Training `in` values expected as argument 0")));
+      Exception::Error(String::New("Network is training")));
     return scope.Close(Undefined());
   }
-  if(!args[1]->IsArray()) {
+
+  vector<uint32_t> idx;
+  vector<double> val;
+  bool sparse = NN::SparseArg(args[0], &idx, &val);
+
+  if(!sparse && !args[0]->IsArray()) {
     ThrowException(
-      Exception::TypeError(
-        String::New("Training `out` values expected as argument 0")));
+      Exception::TypeError(String::New("Input expected as argument 0")));
     return scope.Close(Undefined());
   }
 
-  /* training set extraction */
-  Local<Array> in = Array::Cast(*args[0]);
-  Local<Array> out = Array::Cast(*args[1]);
+  /* call */
+  vector<double> out;
+  if(sparse) {
+    out = nn->run_sparse(idx, val);
+  }
+  else {
+    Local<Array> l = Array::Cast(*args[0]);
+    vector<double> input(l->Length());
 
-  vector<double> input(in->Length());
-  vector<double> output(out->Length());
+    for(unsigned int i = 0; i < l->Length(); i ++) {
+      input[i] = l->Get(Integer::New(i))->ToNumber()->Value();
+    }
 
-  for(unsigned int i = 0; i < in->Length(); i ++) {
-    input[i] = in->Get(Integer::New(i))->ToNumber()->Value();
-  }
-  for(unsigned int i = 0; i < out->Length(); i ++) {
-    output[i] = out->Get(Integer::New(i))->ToNumber()->Value();
+    out = nn->run(input);
   }
 
-  nn->train_set_add(input, output);
+  /* return values */
+  v8::Handle<v8::Array> result = v8::Array::New(out.size());
+  for (size_t i = 0; i < out.size(); i++)
+    result->Set(Integer::New(i), Number::New(out[i]));
 
-  return scope.Close(Undefined());
+  return scope.Close(result);
 }
 
 //
-// ### Train wrapper
+// ### RunBatch wrapper
+// ```
+// @in  {Float64Array|Float32Array} packed input vectors
+// @n   {Number} number of inputs (optional, all the inputs of `in` by default)
+// @out {Float64Array|Float32Array} where to write the outputs, of the same type
+//      as `in` (optional, created by default)
+// ```
 //
-Handle<Value> NN::Train(const Arguments& args) {
+Handle<Value> NN::RunBatch(const Arguments& args) {
   HandleScope scope;
 
-  /* unwraping */
+  /* unwrapping */
   NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
-  /* call */
-  if(args[0]->IsNumber() && args[1]->IsNumber()) {
-    nn->train(args[0]->ToNumber()->Value(),
-              (int)args[1]->ToNumber()->Value());
+  /* `hogwild_train` updates the weights without any lock */
+  if(nn->hogwild_running()) {
+    ThrowException(
+      Exception::Error(String::New("Network is training")));
+    return scope.Close(Undefined());
   }
-  else if(args[0]->IsNumber()) {
-    nn->train(args[0]->ToNumber()->Value());
+
+  if(!args[0]->IsObject() ||
+     !args[0]->ToObject()->HasIndexedPropertiesInExternalArrayData()) {
+    ThrowException(
+      Exception::TypeError(String::New("Typed array expected as argument 0")));
+    return scope.Close(Undefined());
   }
-  else {
-    nn->train();
+  Local<Object> in = args[0]->ToObject();
+  ExternalArrayType type = in->GetIndexedPropertiesExternalArrayDataType();
+  if(type != kExternalDoubleArray && type != kExternalFloatArray) {
+    ThrowException(
+      Exception::TypeError(
+        String::New("Float64Array or Float32Array expected as argument 0")));
+    return scope.Close(Undefined());
   }
 
-  return scope.Close(Undefined());
-}
-
-//
-// ### Multithread Train Wrapper
-//
-Handle<Value> NN::MTTrain(const Arguments& args) {
-  HandleScope scope;
-
-  double target_error = 0;
-  int iterations = 0;
-  int step_size = 0;
-  int threads = 0;
-
-  Local<Function> cb;
-
-  if(args[0]->IsNumber() && args[1]->IsNumber() &&
-     args[2]->IsNumber() && args[3]->IsNumber()) {
-    target_error = args[0]->ToNumber()->Value();
-    iterations = (int)args[1]->ToNumber()->Value();
-    step_size = (int)args[2]->ToNumber()->Value();
-    threads = (int)args[3]->ToNumber()->Value();
+  int in_dim = nn->input_size();
+  int out_dim = nn->output_size();
+  int length = in->GetIndexedPropertiesExternalArrayDataLength();
 
-    cb = Local<Function>::Cast(args[4]);
+  int n = length / in_dim;
+  if(args[1]->IsNumber()) {
+    n = (int)args[1]->ToNumber()->Value();
   }
-  else if(args[0]->IsNumber() && args[1]->IsNumber() && args[2]->IsNumber()) {
-    target_error = args[0]->ToNumber()->Value();
-    iterations = (int)args[1]->ToNumber()->Value();
-    step_size = (int)args[2]->ToNumber()->Value();
-
-    cb = Local<Function>::Cast(args[3]);
+  if(n < 0 || (long long)n * in_dim > length) {
+    ThrowException(
+      Exception::RangeError(String::New("Not enough inputs in argument 0")));
+    return scope.Close(Undefined());
   }
-  else if(args[0]->IsNumber() && args[1]->IsNumber()) {
-    target_error = args[0]->ToNumber()->Value();
-    iterations = (int)args[1]->ToNumber()->Value();
 
-    cb = Local<Function>::Cast(args[2]);
+  Local<Object> out;
+  if(args[2]->IsObject()) {
+    out = args[2]->ToObject();
+    if(!out->HasIndexedPropertiesInExternalArrayData() ||
+       out->GetIndexedPropertiesExternalArrayDataType() != type) {
+      ThrowException(
+        Exception::TypeError(
+          String::New("Typed array of the type of the inputs expected")));
+      return scope.Close(Undefined());
+    }
+    if(out->GetIndexedPropertiesExternalArrayDataLength() <
+       (long long)n * out_dim) {
+      ThrowException(
+        Exception::RangeError(String::New("Output array is too small")));
+      return scope.Close(Undefined());
+    }
+  }
+  else {
+    const char* name =
+      type == kExternalDoubleArray ? "Float64Array" : "Float32Array";
+    Local<Function> ctor = Local<Function>::Cast(
+        Context::GetCurrent()->Global()->Get(String::NewSymbol(name)));
+    Handle<Value> argv[] = { Integer::New(n * out_dim) };
+    out = ctor->NewInstance(1, argv);
   }
-  else if(args[0]->IsNumber()) {
-    target_error = args[0]->ToNumber()->Value();
 
-    cb = Local<Function>::Cast(args[1]);
+  /* call */
+  if(type == kExternalDoubleArray) {
+    nn->run_batch(
+      (const double*)in->GetIndexedPropertiesExternalArrayData(),
+      (double*)out->GetIndexedPropertiesExternalArrayData(), n);
   }
   else {
-    cb = Local<Function>::Cast(args[0]);
+    nn->run_batch(
+      (const float*)in->GetIndexedPropertiesExternalArrayData(),
+      (float*)out->GetIndexedPropertiesExternalArrayData(), n);
   }
 
-  NN* nn = ObjectWrap::Unwrap<NN>(args.This());
-
-  MT_NN::TrainWorker *worker = new MT_NN::TrainWorker();
-
-  worker->request.data = worker;
-  worker->cb = Persistent<Function>::New(cb);
-  worker->nn = nn;
-
-  worker->target_error = target_error;
-  worker->iterations = iterations;
-  worker->step_size = step_size;
-  worker->threads = threads;
-
-  uv_queue_work(uv_default_loop(), &worker->request,
-                MT_NN::train_start, MT_NN::train_done);
-
-  return scope.Close(Undefined());
+  return scope.Close(out);
 }
 
-
 //
-// ### Run wrapper
+// ### RunAsync wrapper
+// ```
+// @in {Array} input vector
+// @cb {Function} called with the output vector
+// ```
 //
-Handle<Value> NN::Run(const Arguments& args) {
+Handle<Value> NN::RunAsync(const Arguments& args) {
   HandleScope scope;
 
   /* unwrapping */
   NN* nn = ObjectWrap::Unwrap<NN>(args.This());
 
+  /* `hogwild_train` updates the weights without any lock */
+  if(nn->hogwild_running()) {
+    ThrowException(
+      Exception::Error(String::New("Network is training")));
+    return scope.Close(Undefined());
+  }
+
   if(!args[0]->IsArray()) {
     ThrowException(
       Exception::TypeError(String::New("Input expected as argument 0")));
     return scope.Close(Undefined());
   }
+  if(!args[1]->IsFunction()) {
+    ThrowException(
+      Exception::TypeError(String::New("Callback expected as argument 1")));
+    return scope.Close(Undefined());
+  }
 
   Local<Array> l = Array::Cast(*args[0]);
-  vector<double> input(l->Length());
+  if((int)l->Length() != nn->input_size()) {
+    ThrowException(
+      Exception::TypeError(String::New("Incompatible input dimensions")));
+    return scope.Close(Undefined());
+  }
 
-  for(unsigned int i = 0; i < l->Length(); i ++) {
-    input[i] = l->Get(Integer::New(i))->ToNumber()->Value();
+  MT_NN::RunWorker* worker = nn->run_pending_;
+  if(worker == NULL) {
+    worker = new MT_NN::RunWorker();
+    worker->request.data = worker;
+    worker->nn = nn;
+    worker->n = 0;
+    nn->run_pending_ = worker;
   }
 
-  /* call */
-  vector<double> out = nn->run(input);
+  for(unsigned int i = 0; i < l->Length(); i ++) {
+    worker->in.push_back(l->Get(Integer::New(i))->ToNumber()->Value());
+  }
+  worker->cbs.push_back(
+    Persistent<Function>::New(Local<Function>::Cast(args[1])));
+  worker->n++;
 
-  /* return values */
-  v8::Handle<v8::Array> result = v8::Array::New(out.size());
-  for (size_t i = 0; i < out.size(); i++)
-    result->Set(Integer::New(i), Number::New(out[i]));
+  nn->run_dispatch(false);
 
-  return scope.Close(result);
+  return scope.Close(Undefined());
 }
 
 //
 // ### New
+// ```
+// @layers    {Array|String} the layers or the string of a network
+// @precision {String} `float32` or `float64` (optional)
+// ```
 //
 Handle<Value> NN::New(const Arguments& args) {
   HandleScope scope;
   NN* nn = NULL;
 
-  if(args[0]->IsString()) {
+  bool single = false;
+  if(args[1]->IsString()) {
+    std::string precision = std::string(
+        *v8::String::Utf8Value(args[1]->ToString()));
+
+    if(precision == "float32") {
+      single = true;
+    }
+    else if(precision != "float64") {
+      ThrowException(
+        Exception::TypeError(String::New("Unknown precision")));
+      return scope.Close(Undefined());
+    }
+  }
+
+  if(args[0]->IsExternal()) {
+    /* network built natively (see `Load`) */
+    nn = (NN*)Local<External>::Cast(args[0])->Value();
+  }
+
+  else if(args[0]->IsString()) {
     std::string str = std::string(
         *v8::String::Utf8Value(args[0]->ToString()));
 
-    nn = new NN(str);
+    /* single precision networks strings end with a `float32` token */
+    size_t end = str.find_last_not_of(" \t\r\n");
+    if(end != std::string::npos && end >= 7 &&
+       str.compare(end - 6, 7, "float32") == 0) {
+      single = true;
+    }
+
+    if(single)
+      nn = new Net<float>(str);
+    else
+      nn = new Net<double>(str);
   }
 
   else if(args[0]->IsArray()) {
@@ -920,7 +1405,31 @@ Handle<Value> NN::New(const Arguments& args) {
       layers[i] = l->Get(Integer::New(i))->ToInteger()->Value();
     }
 
-    nn = new NN(layers);
+    /* activations of the layers but the input one */
+    vector<int> acts;
+    if(args[2]->IsArray()) {
+      Local<Array> a = Array::Cast(*args[2]);
+      if(a->Length() != l->Length() - 1) {
+        ThrowException(
+          Exception::TypeError(String::New("One activation by layer expected")));
+        return scope.Close(Undefined());
+      }
+      for(unsigned int i = 0; i < a->Length(); i++) {
+        int act = ACT_NN::parse(std::string(
+              *v8::String::Utf8Value(a->Get(Integer::New(i))->ToString())));
+        if(act < 0) {
+          ThrowException(
+            Exception::TypeError(String::New("Unknown activation")));
+          return scope.Close(Undefined());
+        }
+        acts.push_back(act);
+      }
+    }
+
+    if(single)
+      nn = new Net<float>(layers, 0.3f, 0.1f, -1.0f, acts);
+    else
+      nn = new Net<double>(layers, 0.3, 0.1, -1.0, acts);
   }
 
   else {
@@ -971,22 +1480,49 @@ void NN::Init(Handle<Object> exports)
 
   tpl->PrototypeTemplate()->Set(String::NewSymbol("train_set_add"),
       FunctionTemplate::New(TrainSetAdd)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("train_set_add_bulk"),
+      FunctionTemplate::New(TrainSetAddBulk)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("train_set_mmap"),
+      FunctionTemplate::New(TrainSetMmap)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("train"),
       FunctionTemplate::New(Train)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("mt_train"),
       FunctionTemplate::New(MTTrain)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("hogwild_train"),
+      FunctionTemplate::New(HogwildTrain)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("cancel"),
+      FunctionTemplate::New(Cancel)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("set_stats"),
+      FunctionTemplate::New(SetStats)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("get_stats"),
+      FunctionTemplate::New(GetStats)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("set_cache"),
+      FunctionTemplate::New(SetCache)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("get_cache"),
+      FunctionTemplate::New(GetCache)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("run"),
       FunctionTemplate::New(Run)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("run_async"),
+      FunctionTemplate::New(RunAsync)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("run_batch"),
+      FunctionTemplate::New(RunBatch)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("to_string"),
       FunctionTemplate::New(ToString)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("get_state"),
       FunctionTemplate::New(GetState)->GetFunction());
   tpl->PrototypeTemplate()->Set(String::NewSymbol("set_log"),
       FunctionTemplate::New(SetLog)->GetFunction());
-
-  Persistent<Function> constructor =
-    Persistent<Function>::New(tpl->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("precision"),
+      FunctionTemplate::New(Precision)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("save"),
+      FunctionTemplate::New(Save)->GetFunction());
+  tpl->PrototypeTemplate()->Set(String::NewSymbol("prune"),
+      FunctionTemplate::New(Prune)->GetFunction());
+
+  constructor = Persistent<Function>::New(tpl->GetFunction());
   exports->Set(String::NewSymbol("NN"), constructor);
+  exports->Set(String::NewSymbol("load"),
+      FunctionTemplate::New(Load)->GetFunction());
 }
 
 void InitAll(Handle<Object> exports) {
@@ -1000,6 +1536,74 @@ NODE_MODULE(nn, InitAll)
 /*                           MULTITHREAD TRAINING                             */
 /******************************************************************************/
 
+//
+// ### train_queue
+// Queues the training on the threadpool
+// ```
+// @worker   {TrainWorker} the training parameters
+// @progress {Function} the optional `on_progress` callback
+// ```
+//
+void MT_NN::train_queue(TrainWorker* worker, Handle<Value> progress) {
+  worker->reported = false;
+  worker->start = uv_hrtime();
+
+  if(!progress.IsEmpty() && progress->IsFunction()) {
+    worker->progress_cb =
+      Persistent<Function>::New(Local<Function>::Cast(progress));
+    worker->async.data = worker;
+    uv_mutex_init(&worker->mutex);
+    uv_async_init(uv_default_loop(), &worker->async, MT_NN::train_progress);
+  }
+
+  worker->nn->set_training(worker);
+  uv_queue_work(uv_default_loop(), &worker->request,
+                MT_NN::train_start, MT_NN::train_done);
+}
+
+//
+// ### train_progress
+// Delivers the last report of the training thread to `on_progress`
+//
+void MT_NN::train_progress(uv_async_t* async, int status) {
+  HandleScope scope;
+  TrainWorker* worker = static_cast<TrainWorker*>(async->data);
+
+  uv_mutex_lock(&worker->mutex);
+  bool reported = worker->reported;
+  worker->reported = false;
+  int iteration = worker->iteration;
+  double error = worker->error;
+  double samples = worker->samples;
+  double elapsed = worker->elapsed;
+  uv_mutex_unlock(&worker->mutex);
+
+  if(!reported) {
+    return;
+  }
+
+  Local<Object> report = Object::New();
+  report->Set(String::NewSymbol("iteration"), Integer::New(iteration));
+  report->Set(String::NewSymbol("error"), Number::New(error));
+  report->Set(String::NewSymbol("samples_per_sec"),
+              Number::New(elapsed > 0 ? samples / elapsed : 0));
+  report->Set(String::NewSymbol("elapsed"), Number::New(elapsed * 1000));
+
+  Local<Value> argv[] = { report };
+  worker->progress_cb->Call(Context::GetCurrent()->Global(), 1, argv);
+}
+
+//
+// ### train_close
+//
+void MT_NN::train_close(uv_handle_t* handle) {
+  TrainWorker* worker = static_cast<TrainWorker*>(handle->data);
+
+  uv_mutex_destroy(&worker->mutex);
+  worker->progress_cb.Dispose();
+  delete worker;
+}
+
 //
 // ### train_start
 // Start the multithreaded training session. Takes care of creation threads and
@@ -1016,22 +1620,22 @@ void MT_NN::train_start(uv_work_t* req) {
   int iterations = worker->iterations;
   int step_size = worker->step_size;
   int threads = worker->threads;
+  int batch_size = worker->batch_size;
 
-  if(target_error > 0 && iterations > 0 && step_size > 0 && threads > 0) {
-    nn->mt_train(target_error, iterations, step_size, threads);
-  }
-  else if (target_error > 0 && iterations > 0 && step_size > 0) {
-    nn->mt_train(target_error, iterations, step_size);
-  }
-  else if(target_error > 0 && iterations > 0) {
-    nn->mt_train(target_error, iterations);
-  }
-  else if(target_error > 0) {
-    nn->mt_train(target_error);
-  }
-  else {
-    nn->mt_train();
+  if(worker->hogwild) {
+    nn->hogwild_train(target_error > 0 ? target_error : 0.01,
+                      iterations > 0 ? iterations : 20000,
+                      threads > 0 ? threads : 4);
+    return;
   }
+
+  /* the defaults of `mt_train` for the options not given */
+  nn->mt_train(target_error > 0 ? target_error : 0.01,
+               iterations > 0 ? iterations : 20000,
+               step_size > 0 ? step_size : 100,
+               threads > 0 ? threads : 4,
+               batch_size > 0 ? batch_size : 1,
+               worker->tune);
 }
 
 //
@@ -1041,6 +1645,12 @@ void MT_NN::train_done(uv_work_t* req, int status) {
   HandleScope scope;
   TrainWorker* worker = static_cast<TrainWorker*>(req->data);
 
+  worker->nn->set_training(NULL);
+  if(!worker->progress_cb.IsEmpty()) {
+    /* the last report may still be waiting for the loop */
+    MT_NN::train_progress(&worker->async, 0);
+  }
+
   if(!worker->error_message.empty()) {
     Local<Value> err = Exception::Error(
                          String::New(worker->error_message.c_str()));
@@ -1055,68 +1665,56 @@ void MT_NN::train_done(uv_work_t* req, int status) {
   }
 
   worker->cb.Dispose();
-  delete worker;
+
+  if(!worker->progress_cb.IsEmpty()) {
+    uv_close((uv_handle_t*)&worker->async, MT_NN::train_close);
+  }
+  else {
+    delete worker;
+  }
 }
 
 //
-// ### split_data
-// Split data among received NNs
-// ```
-// @nns       {NN[]} an array of NNs
-// @no_nns    {int} the number of NNs
-// @step      {int} the step number
-// @step_size {int} the step size
-// @train_in  {vector< vector <double> >} the training set ins
-// @train_out {vector< vector <double> >} the training set outs
-//
-// @return    {int} the total number of points added
-// ```
+// ### run_start
+// Runs a batch of `run_async` requests on the threadpool
 //
-int MT_NN::split_data(NN** nns, int no_nns, int step, int step_size,
-                      vector< vector<double> > train_in,
-                      vector< vector<double> > train_out)
-{
-  unsigned int total = 0;
-  int max_to_insert = std::min((step + 1) * no_nns * step_size,
-                          (int)train_in.size());
-  int to_insert = 0;
-
-  while(to_insert < max_to_insert - 1) {
-    if(step_size > (int)train_in.size()) {
-      to_insert = total % train_in.size();
-    }
-    else {
-      to_insert = total + ((step * no_nns * step_size) % train_in.size());
-    }
-
-    if((int)train_in.size() > to_insert && (int)train_out.size() > to_insert) {
-      nns[total % no_nns]->train_set_add(train_in[to_insert],
-                                         train_out[to_insert]);
-    }
-    else {
-      cout << "Wrong training set: IN " << train_in.size() <<
-        " OUT " << train_out.size();
-      /* Stop here */
-      total = train_in.size();
-    }
-
-    total ++;
-  }
+void MT_NN::run_start(uv_work_t* req) {
+  RunWorker* worker = static_cast<RunWorker*>(req->data);
+  NN* nn = worker->nn;
 
-  return total;
+  worker->out.resize((size_t)worker->n * nn->output_size());
+  nn->run_cached(&worker->in[0], &worker->out[0], worker->n);
 }
 
 //
-// ### learn
-// Runs the NN learn step
-// ```
-// @arg {} the NN to train
-// ```
+// ### run_done
+// Queues the requests received in the meantime then calls back the requests of
+// the batch
 //
-void MT_NN::learn(void *arg) {
-  LearnWorker *worker = (LearnWorker*)arg;
+void MT_NN::run_done(uv_work_t* req, int status) {
+  HandleScope scope;
+  RunWorker* worker = static_cast<RunWorker*>(req->data);
+  int out_dim = worker->nn->output_size();
 
-  NN *nn = worker->nn;
+  /* the network may be collected from here */
+  worker->nn->run_dispatch(true);
 
-  worker->error = nn->learn_step();
+  for(int k = 0; k < worker->n; k++) {
+    Local<Array> result = Array::New(out_dim);
+    for(int j = 0; j < out_dim; j++) {
+      result->Set(Integer::New(j),
+                  Number::New(worker->out[(size_t)k * out_dim + j]));
+    }
+
+    Local<Value> argv[] = {
+      Local<Value>::New(Null()),
+      result
+    };
+    worker->cbs[k]->Call(Context::GetCurrent()->Global(), 2, argv);
+    worker->cbs[k].Dispose();
+  }
+
+  delete worker;
 }
+
+#endif
@@ -19,28 +19,56 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
 // USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+#ifndef NN_NN_HH
+#define NN_NN_HH
+
+/* NN_STANDALONE builds the network core alone, without V8 and the bindings */
+/* (used by the native benchmark)                                          */
+#ifndef NN_STANDALONE
 #include <node.h>
 #include <v8.h>
+#endif
 #include <assert.h>
 #include <vector>
+#include <string>
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdint.h>
 #include <uv.h>
 
+#include "cache.hh"
+
+/* Alignment (in bytes) of every layer block and weight row */
+#define NN_ALIGN 64
+/* Buckets of the `run` latency histogram: bucket k counts [2^k, 2^(k+1)) ns */
+#define NN_LATENCY_BUCKETS 32
+
+#ifndef NN_STANDALONE
 using namespace v8;
 using namespace node;
+#endif
 using namespace std;
 
+namespace MT_NN {
+  struct RunWorker;
+  struct TrainWorker;
+};
+
 //
 // ## NN Class
+// The object exposed to Javascript. The network itself is implemented by
+// `Net<T>` (see net.hh) for the scalar type chosen at construction.
 //
+#ifndef NN_STANDALONE
 class NN : public ObjectWrap {
+#else
+class NN {
+#endif
 public:
-  NN(vector<int> &, double, double, double);
-  NN(std::string &);
-  NN(NN const&);
-  ~NN();
+  NN();
+  virtual ~NN();
 
   /**************************************************************************/
   /*                               METHODS                                  */
@@ -55,13 +83,117 @@ public:
   //
   static double fRand(double, double);
 
+  //
+  // ### alloc / release
+  // NN_ALIGN aligned blocks, zeroed unless they are about to be overwritten
+  // ```
+  // @size {size_t} size in bytes
+  // @zero {bool} whether to zero the block
+  // ```
+  //
+  static void* alloc(size_t, bool = true);
+  static void release(void*);
+
+  //
+  // ## Blob struct
+  // A whole file in memory: either mapped (copy on write) or read in a block
+  // returned by `alloc`
+  //
+  struct Blob {
+    Blob() : data(NULL), size(0), mapped(false) {}
+
+    char* data;
+    size_t size;
+    bool mapped;
+  };
+
+  //
+  // ### blob_load
+  // ```
+  // @path     {std::string} the file path
+  // @map      {bool} whether to mmap the file rather than reading it
+  // @blob     {Blob} the blob to fill
+  // @writable {bool} whether the mapping may be written (copy on write)
+  //
+  // @return {bool} false if the file could not be loaded
+  // ```
+  //
+  static bool blob_load(const std::string&, bool, Blob*, bool writable = true);
+
+  //
+  // ### blob_release
+  // ```
+  // @blob {Blob} a blob filled by `blob_load`
+  // ```
+  //
+  static void blob_release(Blob*);
+
+  //
+  // ### blob_prefetch
+  // Hints that a range of a mapped blob will be read soon
+  // ```
+  // @blob   {Blob} the blob
+  // @offset {size_t} start of the range in bytes
+  // @size   {size_t} size of the range in bytes
+  // ```
+  //
+  static void blob_prefetch(Blob*, size_t, size_t);
+
+  //
+  // ### load
+  // Loads a network saved with `save`, with the precision it was saved with
+  // ```
+  // @path {std::string} the file path
+  // @map  {bool} whether to mmap the weights rather than reading them
+  //
+  // @return {NN*} the network, NULL if the file is not a valid network
+  // ```
+  //
+  static NN* load(const std::string&, bool);
+
+  //
+  // ### precision
+  // `float32` or `float64`
+  //
+  virtual const char* precision() = 0;
+
   //
   // ### run
   // ```
   // @in {vector<double>} input vector
   // ```
   //
-  vector<double> run(vector<double> &);
+  virtual vector<double> run(vector<double> &) = 0;
+
+  //
+  // ### run_sparse
+  // ```
+  // @idx {vector<uint32_t>} indices of the non-zero inputs
+  // @val {vector<double>} their values
+  // ```
+  //
+  virtual vector<double> run_sparse(vector<uint32_t> &,
+                                    vector<double> &) = 0;
+
+  //
+  // ### run_batch
+  // Re-entrant: can be called from any number of threads at once, including
+  // while the network is trained
+  // ```
+  // @in  {const double*|const float*} `n` packed input vectors
+  // @out {double*|float*} `n` packed output vectors
+  // @n   {int} number of inputs
+  // ```
+  //
+  virtual void run_batch(const double*, double*, int) const = 0;
+  virtual void run_batch(const float*, float*, int) const = 0;
+
+  //
+  // ### input_size / output_size
+  // Sizes of the first and last layers
+  //
+  virtual int input_size() = 0;
+  virtual int output_size() = 0;
 
   //
   // ### train_set_add
@@ -70,13 +202,60 @@ public:
   // @out        {vector<double>} result vector to learn on
   // ```
   //
-  void train_set_add(vector<double> &,
-                     vector<double> &);
+  virtual void train_set_add(vector<double> &,
+                             vector<double> &) = 0;
+
+  //
+  // ### train_set_add_sparse
+  // ```
+  // @idx {vector<uint32_t>} indices of the non-zero inputs
+  // @val {vector<double>} their values
+  // @out {vector<double>} result vector to learn on
+  // ```
+  //
+  virtual void train_set_add_sparse(vector<uint32_t> &,
+                                    vector<double> &,
+                                    vector<double> &) = 0;
+
+  //
+  // ### train_set_add
+  // Bulk append
+  // ```
+  // @in  {const double*|const float*} `n` packed input vectors
+  // @out {const double*|const float*} `n` packed result vectors
+  // @n   {size_t} number of points
+  // ```
+  //
+  virtual void train_set_add(const double*,
+                             const double*,
+                             size_t) = 0;
+  virtual void train_set_add(const float*,
+                             const float*,
+                             size_t) = 0;
 
   //
   // ### train_set_clear
   //
-  void train_set_clear();
+  virtual void train_set_clear() = 0;
+
+  //
+  // ### train_set_size
+  // Number of points in the training set
+  //
+  virtual size_t train_set_size() = 0;
+
+  //
+  // ### train_set_mmap
+  // Trains on a file of packed records (the input vector followed by the result
+  // vector, in the precision of the network) mapped in memory, replacing the
+  // current training set
+  // ```
+  // @path {std::string} the file path
+  //
+  // @return {bool} false if the file could not be mapped
+  // ```
+  //
+  virtual bool train_set_mmap(const std::string&) = 0;
 
   //
   // ### train
@@ -84,9 +263,12 @@ public:
   // ```
   // @error      {double} target error
   // @iterations {int} max number of iterations
+  // @batch_size {int} number of samples by weights update
   // ```
   //
-  void train(double, int);
+  virtual void train(double error = 0.01,
+                     int iterations = 20000,
+                     int batch_size = 1) = 0;
 
   //
   // ### mt_train
@@ -96,40 +278,245 @@ public:
   // @iterations {int} max number of iterations
   // @step_size  {int} size of training set by step
   // @n_threads  {int} the number of threads to use
+  // @batch_size {int} number of samples by weights update
+  // @tune       {bool} whether to choose the step size and the number of
+  //                    threads (up to `n_threads`) automatically
   // ```
   //
-  void mt_train(double, int, int, int);
+  virtual void mt_train(double error = 0.01,
+                        int iterations = 20000,
+                        int step_size = 100,
+                        int thread = 4,
+                        int batch_size = 1,
+                        bool tune = false) = 0;
 
   //
-  // ### learn
+  // ### hogwild_train
+  // Lock-free multithreaded train: the threads learn their shard of the
+  // training set on the shared weights, with neither replicas nor barrier
   // ```
-  // @in {vector<double>} input vector
-  // @out {vector<double>} result vector
+  // @error      {double} target error
+  // @iterations {int} max number of iterations
+  // @n_threads  {int} the number of threads to use
   // ```
   //
-  vector<double> learn(vector<double> &,
-                       vector<double> &);
+  virtual void hogwild_train(double error = 0.01,
+                             int iterations = 20000,
+                             int thread = 4) = 0;
 
   //
-  // ### learn_step
+  // ### to_string
   //
-  double learn_step();
+  virtual std::string to_string() = 0;
 
   //
-  // ### to_string
+  // ### get_state
   //
-  std::string to_string();
+  virtual std::string get_state(bool compact = false) = 0;
 
   //
-  // ### get_state
+  // ### save
+  // Writes the network in the binary format read by `load`
+  // ```
+  // @path {std::string} the file path
+  //
+  // @return {bool} false if the file could not be written
+  // ```
+  //
+  virtual bool save(const std::string&) = 0;
+
+  //
+  // ### prune
+  // Removes the weights of smallest magnitude and stores the layers as
+  // compressed rows, used by the inference and the (fine-tuning) training
+  // ```
+  // @threshold {double} magnitude up to which the weights are removed
+  // @sparsity  {double} fraction of the weights of each layer to remove
+  //                     instead, if not negative
   //
-  std::string get_state(bool);
+  // @return {double} the fraction of the weights removed, -1 on error
+  // ```
+  //
+  virtual double prune(double, double) = 0;
 
   //
   // ### set_log
   //
   void set_log(bool);
 
+  //
+  // ### run_dispatch
+  // Queues the pending `run_async` requests as one batch on the threadpool,
+  // unless a batch of this network is already running
+  // ```
+  // @done {bool} whether the running batch is done
+  // ```
+  //
+  void run_dispatch(bool);
+
+  //
+  // ### set_training
+  // ```
+  // @worker {TrainWorker} the asynchronous training running, NULL once done
+  // ```
+  //
+  void set_training(MT_NN::TrainWorker*);
+
+  //
+  // ### hogwild_running
+  // Whether a `hogwild_train` is running: its threads update the weights
+  // without any lock, so nothing else may read them meanwhile
+  //
+  bool hogwild_running();
+
+  //
+  // ### progress
+  // Reports the end of a training iteration to the `on_progress` callback of
+  // the asynchronous training running, if any
+  // ```
+  // @it      {int} the iteration
+  // @error   {double} the error of the iteration
+  // @samples {double} the number of points learnt since the training started
+  // ```
+  //
+  void progress(int, double, double);
+
+  //
+  // ### cancel / cancelled
+  // Asks the asynchronous training running to stop at the end of its current
+  // step. Can be called from any thread.
+  //
+  void cancel();
+  bool cancelled();
+
+  //
+  // ## Stats struct
+  // Counters of the training and inference hot paths. They are only collected
+  // when the module is compiled with NN_STATS and enabled with `set_stats`.
+  // Every counter is updated atomically: inference runs from any thread.
+  //
+  enum Phase {
+    PHASE_TRAIN = 0,                     /* monothreaded learning */
+    PHASE_CLONE,                         /* replicas creation */
+    PHASE_SPLIT,                         /* `split_data` */
+    PHASE_LEARN,                         /* multithreaded learning */
+    PHASE_MERGE,                         /* replicas merge */
+    PHASE_ERROR,                         /* error computation */
+    PHASE_COUNT
+  };
+
+  struct Stats {
+    uint64_t flops;                      /* floating point operations */
+    uint64_t train_samples;              /* points learnt */
+    uint64_t run_samples;                /* inputs run */
+    uint64_t phases[PHASE_COUNT];        /* wall time by phase (ns) */
+    uint64_t latency[NN_LATENCY_BUCKETS]; /* run calls by latency */
+  };
+
+  //
+  // ### set_stats
+  // Enables (and resets) or disables the stats collection
+  // ```
+  // @enabled {bool}
+  // ```
+  //
+  void set_stats(bool);
+
+  //
+  // ### get_stats
+  // ```
+  // @stats {Stats} filled with a snapshot of the counters
+  //
+  // @return {bool} whether the stats are collected
+  // ```
+  //
+  bool get_stats(Stats*) const;
+
+  //
+  // ### stats_clock
+  // ```
+  // @return {uint64_t} the current time, 0 if the stats are not collected
+  // ```
+  //
+  uint64_t stats_clock() const {
+#ifdef NN_STATS
+    return stats_on_ ? uv_hrtime() : 0;
+#else
+    return 0;
+#endif
+  }
+
+  //
+  // ### stats_phase
+  // ```
+  // @phase {Phase} the phase
+  // @since {uint64_t} the `stats_clock` at the start of the phase
+  // ```
+  //
+  void stats_phase(int phase, uint64_t since) const {
+#ifdef NN_STATS
+    if(since != 0) {
+      __sync_fetch_and_add(&stats_.phases[phase], uv_hrtime() - since);
+    }
+#endif
+  }
+
+  //
+  // ### stats_train
+  // ```
+  // @samples {uint64_t} points learnt
+  // @flops   {uint64_t} floating point operations by point
+  // ```
+  //
+  void stats_train(uint64_t samples, uint64_t flops) const {
+#ifdef NN_STATS
+    if(stats_on_) {
+      __sync_fetch_and_add(&stats_.train_samples, samples);
+      __sync_fetch_and_add(&stats_.flops, samples * flops);
+    }
+#endif
+  }
+
+  //
+  // ### stats_run
+  // ```
+  // @samples {uint64_t} inputs run
+  // @flops   {uint64_t} floating point operations by input
+  // @since   {uint64_t} the `stats_clock` at the start of the call
+  // ```
+  //
+  void stats_run(uint64_t samples, uint64_t flops, uint64_t since) const;
+
+  //
+  // ### set_cache
+  // Empties the outputs cache of `run` and `run_async` and sets its capacity
+  // ```
+  // @capacity {int} max number of cached inputs, 0 to disable the cache
+  // ```
+  //
+  void set_cache(int);
+
+  //
+  // ### get_cache
+  // ```
+  // @counters {Cache::Counters} filled with a snapshot of the counters
+  // ```
+  //
+  void get_cache(Cache::Counters*);
+
+  //
+  // ### run_cached
+  // `run_batch` going through the outputs cache: only the inputs missing from
+  // the cache are run, in a single batch
+  // ```
+  // @in  {const double*} `n` packed input vectors
+  // @out {double*} `n` packed output vectors
+  // @n   {int} number of inputs
+  // ```
+  //
+  void run_cached(const double*, double*, int);
+
+#ifndef NN_STANDALONE
   /**************************************************************************/
   /*                                BINDINGS                                */
   /**************************************************************************/
@@ -142,47 +529,55 @@ private:
   //
   static Handle<Value> New(const Arguments& args);
   static Handle<Value> TrainSetAdd(const Arguments& args);
+  static Handle<Value> TrainSetAddBulk(const Arguments& args);
+  static Handle<Value> TrainSetMmap(const Arguments& args);
   static Handle<Value> Train(const Arguments& args);
   static Handle<Value> MTTrain(const Arguments& args);
+  static Handle<Value> HogwildTrain(const Arguments& args);
+  static Handle<Value> Cancel(const Arguments& args);
+  static Handle<Value> SetStats(const Arguments& args);
+  static Handle<Value> GetStats(const Arguments& args);
+  static Handle<Value> SetCache(const Arguments& args);
+  static Handle<Value> GetCache(const Arguments& args);
   static Handle<Value> Run(const Arguments& args);
+  static Handle<Value> RunBatch(const Arguments& args);
+  static Handle<Value> RunAsync(const Arguments& args);
   static Handle<Value> ToString(const Arguments& args);
   static Handle<Value> GetState(const Arguments& args);
   static Handle<Value> SetLog(const Arguments& args);
+  static Handle<Value> Precision(const Arguments& args);
+  static Handle<Value> Save(const Arguments& args);
+  static Handle<Value> Prune(const Arguments& args);
+  static Handle<Value> Load(const Arguments& args);
 
-  //
-  // ### Operators
-  //
-  NN& operator+=(NN const&);
-  NN& operator-=(NN const&);
-  NN& operator/=(int const&);
+  static bool SparseArg(Handle<Value> arg,
+                        vector<uint32_t>* idx,
+                        vector<double>* val);
+
+  static Persistent<Function> constructor;
+#endif
 
+protected:
   /**************************************************************************/
   /*                              MEMBERS                                   */
   /**************************************************************************/
 
-  vector< vector< vector<double> > > W_;         /* weights */
-  vector< vector< vector<double> > > dW_;        /* changes */
-  vector< vector<double> >           B_;         /* bias weights */
-
-  vector< vector<double> >           D_;         /* deltas */
-  vector< vector<double> >           sum_;       /* incoming sums */
-  vector< vector<double> >           val_;       /* values */
+  bool                               log_;       /* Whether to log outputs */
 
-  vector<int>                        layers_;    /* layers structure */
-  int                                L_;         /* layers count */
-  long                               op_count_;  /* op count */
+  MT_NN::RunWorker*                  run_pending_; /* next `run_async` batch */
+  bool                               run_busy_;  /* a batch is running */
 
-  double                             alpha_;     /* learning rate */
-  double                             beta_;      /* momentum */
-  double                             bias_;      /* bias value */
+  MT_NN::TrainWorker*                training_;  /* asynchronous training */
+  volatile int                       cancel_;    /* training cancelled */
 
-  vector< vector<double> >           train_in_;  /* training set input */
-  vector< vector<double> >           train_out_; /* training set out */
+  bool                               stats_on_;  /* stats collected */
+  mutable Stats                      stats_;     /* hot paths counters */
 
-  bool                               log_;       /* Whether to log outputs */
+  Cache                              cache_;     /* outputs of `run` */
 };
 
 
+#ifndef NN_STANDALONE
 /******************************************************************************/
 /*                           MULTITHREADING HELPERS                           */
 /******************************************************************************/
@@ -191,13 +586,13 @@ namespace MT_NN {
   //
   // ### Functions
   //
+  void train_queue(TrainWorker* worker, Handle<Value> progress);
   void train_start(uv_work_t* req);
   void train_done(uv_work_t* req, int status);
-
-  int split_data(NN**, int, int, int,
-                 vector< vector<double> >,
-                 vector< vector<double> >);
-  void learn(void *arg);
+  void train_progress(uv_async_t* async, int status);
+  void train_close(uv_handle_t* handle);
+  void run_start(uv_work_t* req);
+  void run_done(uv_work_t* req, int status);
 
   //
   // ## TrainWorker struct
@@ -211,15 +606,40 @@ namespace MT_NN {
     int iterations;
     int step_size;
     int threads;
+    int batch_size;
+    bool tune;                             /* automatic step size / threads */
+    bool hogwild;                          /* lock-free `hogwild_train` */
+
+    /* `on_progress` reports, sent from the training thread to the loop */
+    Persistent<Function> progress_cb;
+    uv_async_t async;
+    uv_mutex_t mutex;
+    uint64_t start;                        /* uv_hrtime() at start */
+    bool reported;                         /* a report is not delivered yet */
+    int iteration;
+    double error;
+    double samples;
+    double elapsed;                        /* seconds */
 
     NN* nn;
   };
 
   //
-  // ## LearnWorker struct
+  // ## RunWorker struct
+  // `run_async` requests coalesced in one batched forward pass
   //
-  struct LearnWorker {
+  struct RunWorker {
+    uv_work_t request;
+    vector< Persistent<Function> > cbs;
+
+    vector<double> in;                     /* packed inputs */
+    vector<double> out;                    /* packed outputs */
+    int n;                                 /* number of requests */
+
     NN* nn;
-    double error;
   };
 };
+
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+// Copyright Teleportd Ltd. and other Contributors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "kernels.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+//
+// Checks every vectorized kernel available on the running CPU against the
+// scalar one, for all the lengths up to `MAX_LEN` and every misalignment of
+// the vectors up to 8 elements. `axpy` must also leave the elements around `y`
+// untouched. Prints each mismatch and exits non-zero if there was any.
+//
+// Usage: `kernels_test`
+//
+
+#define MAX_LEN 300
+#define MAX_SHIFT 8
+#define GATHER_LEN 512
+
+/******************************************************************************/
+/*                                 HELPERS                                    */
+/******************************************************************************/
+
+static int failures = 0;
+
+//
+// ### rnd
+// Deterministic values in [-1, 1] so that a failure can be reproduced
+//
+static double rnd()
+{
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return (double)((seed >> 8) & 0xffff) / 32768.0 - 1.0;
+}
+
+//
+// ### eps
+// The relative tolerance used for each precision
+//
+static double eps(double) { return 1e-12; }
+static double eps(float) { return 1e-5; }
+
+//
+// ### close
+// ```
+// @got  {double} the vectorized result
+// @want {double} the scalar result
+// @mag  {double} the magnitude of the summed terms
+// @tol  {double} the relative tolerance
+// ```
+//
+static bool close(double got, double want, double mag, double tol)
+{
+  return fabs(got - want) <= tol * (mag + 1.0);
+}
+
+//
+// ### fail
+// Reports one mismatch
+//
+static void fail(const char* kernel, SIMD_NN::ISA isa, int n, int shift,
+                 double got, double want)
+{
+  printf("FAIL %s %s n=%d shift=%d got=%.17g want=%.17g\n", kernel,
+         SIMD_NN::isa_name(isa), n, shift, got, want);
+  failures++;
+}
+
+/******************************************************************************/
+/*                                  CHECKS                                    */
+/******************************************************************************/
+
+//
+// ### check_dot
+// ```
+// @name {const char*} the kernel name
+// @isa  {ISA} the instruction set of `fn`
+// @fn   {F} the kernel to check
+// @ref  {F} the scalar kernel
+// ```
+//
+template <typename T, typename F>
+static void check_dot(const char* name, SIMD_NN::ISA isa, F fn, F ref)
+{
+  vector<T> a(MAX_LEN + MAX_SHIFT), b(MAX_LEN + 2 * MAX_SHIFT);
+  for(size_t i = 0; i < b.size(); i++) {
+    if(i < a.size()) a[i] = (T)rnd();
+    b[i] = (T)rnd();
+  }
+
+  for(int shift = 0; shift < MAX_SHIFT; shift++) {
+    /* `b` is misaligned differently from `a` */
+    const T* pa = &a[0] + shift;
+    const T* pb = &b[0] + (shift * 3) % MAX_SHIFT + 1;
+    for(int n = 0; n <= MAX_LEN; n++) {
+      double mag = 0;
+      for(int j = 0; j < n; j++) {
+        mag += fabs((double)pa[j] * pb[j]);
+      }
+      double got = fn(pa, pb, n);
+      double want = ref(pa, pb, n);
+      if(!close(got, want, mag, eps((T)0))) {
+        fail(name, isa, n, shift, got, want);
+      }
+    }
+  }
+}
+
+//
+// ### check_axpy
+// ```
+// @name {const char*} the kernel name
+// @isa  {ISA} the instruction set of `fn`
+// @fn   {F} the kernel to check
+// @ref  {F} the scalar kernel
+// ```
+//
+template <typename T, typename F>
+static void check_axpy(const char* name, SIMD_NN::ISA isa, F fn, F ref)
+{
+  vector<T> x(MAX_LEN + MAX_SHIFT), y(MAX_LEN + 2 * MAX_SHIFT);
+  for(size_t i = 0; i < y.size(); i++) {
+    if(i < x.size()) x[i] = (T)rnd();
+    y[i] = (T)rnd();
+  }
+  const T alpha = (T)rnd();
+
+  for(int shift = 0; shift < MAX_SHIFT; shift++) {
+    const T* px = &x[0] + shift;
+    const int off = (shift * 3) % MAX_SHIFT + 1;
+    for(int n = 0; n <= MAX_LEN; n++) {
+      vector<T> got(y), want(y);
+      fn(alpha, px, &got[0] + off, n);
+      ref(alpha, px, &want[0] + off, n);
+      /* the whole of `y`, to catch writes outside of [off, off + n) */
+      for(size_t j = 0; j < y.size(); j++) {
+        double mag = fabs((double)want[j]) + fabs((double)alpha);
+        if(!close(got[j], want[j], mag, eps((T)0))) {
+          fail(name, isa, n, shift, got[j], want[j]);
+          break;
+        }
+      }
+    }
+  }
+}
+
+//
+// ### check_gdot
+// ```
+// @name {const char*} the kernel name
+// @isa  {ISA} the instruction set of `fn`
+// @fn   {F} the kernel to check
+// @ref  {F} the scalar kernel
+// ```
+//
+template <typename T, typename F>
+static void check_gdot(const char* name, SIMD_NN::ISA isa, F fn, F ref)
+{
+  vector<T> a(MAX_LEN + MAX_SHIFT), b(GATHER_LEN);
+  vector<uint32_t> idx(MAX_LEN + MAX_SHIFT);
+  for(size_t i = 0; i < a.size(); i++) {
+    a[i] = (T)rnd();
+    idx[i] = (uint32_t)((rnd() + 1.0) / 2.0 * (GATHER_LEN - 1));
+  }
+  for(size_t i = 0; i < b.size(); i++) {
+    b[i] = (T)rnd();
+  }
+
+  for(int shift = 0; shift < MAX_SHIFT; shift++) {
+    const T* pa = &a[0] + shift;
+    const uint32_t* pi = &idx[0] + (shift * 3) % MAX_SHIFT;
+    for(int n = 0; n <= MAX_LEN; n++) {
+      double mag = 0;
+      for(int j = 0; j < n; j++) {
+        mag += fabs((double)pa[j] * b[pi[j]]);
+      }
+      double got = fn(pa, pi, &b[0], n);
+      double want = ref(pa, pi, &b[0], n);
+      if(!close(got, want, mag, eps((T)0))) {
+        fail(name, isa, n, shift, got, want);
+      }
+    }
+  }
+}
+
+/******************************************************************************/
+/*                                   MAIN                                     */
+/******************************************************************************/
+
+int main()
+{
+  using namespace SIMD_NN;
+
+  for(int i = SSE2; i < ISA_COUNT; i++) {
+    ISA isa = (ISA)i;
+    if(get_dot(isa) == NULL) {
+      printf("skip %s\n", isa_name(isa));
+      continue;
+    }
+    check_dot<double>("dot", isa, get_dot(isa), get_dot(SCALAR));
+    check_axpy<double>("axpy", isa, get_axpy(isa), get_axpy(SCALAR));
+    check_dot<float>("sdot", isa, get_sdot(isa), get_sdot(SCALAR));
+    check_axpy<float>("saxpy", isa, get_saxpy(isa), get_saxpy(SCALAR));
+    check_gdot<double>("gdot", isa, get_gdot(isa), get_gdot(SCALAR));
+    check_gdot<float>("sgdot", isa, get_sgdot(isa), get_sgdot(SCALAR));
+    printf("ok %s\n", isa_name(isa));
+  }
+
+  return failures > 0 ? 1 : 0;
+}